@@ -11,10 +11,13 @@
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	Entries are placed by hashing the file name, probing linearly
+//	from there.  A removed entry is marked "deleted" rather than
+//	free, so the probe sequences running through it stay intact.
+//	When in-use plus deleted entries would pass 3/4 of the table,
+//	Add rehashes into a bigger table; WriteBack then grows the file.
+//	Because the layout on disk is the same hash table, Lookup can
+//	find a name by reading just the few entries it probes.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -24,6 +27,23 @@
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// HashName
+// 	Hash a file name (FNV-1a), looking only at the part of it that
+//	gets stored in a directory entry.
+//----------------------------------------------------------------------
+
+static unsigned int
+HashName(char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    return hash;
+}
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -40,7 +60,8 @@ Directory::Directory(int size)
     table = new DirectoryEntry[size];
     tableSize = size;
     for (int i = 0; i < tableSize; i++)
-	table[i].inUse = FALSE;
+	table[i].inUse = table[i].deleted = FALSE;
+    numInUse = numDeleted = 0;
 }
 
 //----------------------------------------------------------------------
@@ -55,7 +76,8 @@ Directory::~Directory()
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk.  The table takes
+//	the size of the file, which may have grown.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
@@ -63,26 +85,54 @@ Directory::~Directory()
 void
 Directory::FetchFrom(OpenFile *file)
 {
+    int size = file->Length() / sizeof(DirectoryEntry);
+
+    if (size != tableSize) {
+        delete [] table;
+        tableSize = size;
+        table = new DirectoryEntry[tableSize];
+    }
     (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    numInUse = numDeleted = 0;
+    for (int i = 0; i < tableSize; i++) {
+        if (table[i].inUse)
+            numInUse++;
+        else if (table[i].deleted)
+            numDeleted++;
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  Return
+//	FALSE, having written nothing, if the table has grown and the
+//	file can't grow with it: a rehashed table is useless cut short.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
-void
+bool
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int size = tableSize * sizeof(DirectoryEntry);
+    int length = file->Length();
+
+    // grow the file first, by writing the part past its end
+    if (size > length) {
+	if (file->WriteAt((char *)table + length, size - length, length)
+							!= size - length)
+	    return FALSE;
+	size = length;
+    }
+    (void) file->WriteAt((char *)table, size, 0);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
 // 	Look up file name in directory, and return its location in the table of
 //	directory entries.  Return -1 if the name isn't in the directory.
+//	Probe from the name's hash until an entry that was never used.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
@@ -90,9 +140,16 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-	    return i;
+    if (tableSize == 0)
+        return -1;
+    for (int n = 0, i = HashName(name) % tableSize; n < tableSize;
+                                        n++, i = (i + 1) % tableSize) {
+        if (table[i].inUse) {
+            if (!strncmp(table[i].name, name, FileNameMaxLen))
+                return i;
+        } else if (!table[i].deleted)
+            break;
+    }
     return -1;		// name not in directory
 }
 
@@ -115,12 +172,43 @@ Directory::Find(char *name)
     return -1;
 }
 
+//----------------------------------------------------------------------
+// Directory::Lookup
+// 	Like Find, but straight from the directory file, without reading
+//	in the whole table: only the entries on "name"'s probe sequence
+//	are read.  Used to resolve path names.
+//
+//	"file" -- file containing the directory contents
+//	"name" -- the file name to look up
+//----------------------------------------------------------------------
+
+int
+Directory::Lookup(OpenFile *file, char *name)
+{
+    DirectoryEntry entry;
+    int size = file->Length() / sizeof(DirectoryEntry);
+
+    if (size == 0)
+        return -1;
+    for (int n = 0, i = HashName(name) % size; n < size;
+                                        n++, i = (i + 1) % size) {
+        file->ReadAt((char *)&entry, sizeof(DirectoryEntry),
+                                        i * sizeof(DirectoryEntry));
+        if (entry.inUse) {
+            if (!strncmp(entry.name, name, FileNameMaxLen))
+                return entry.sector;
+        } else if (!entry.deleted)
+            break;
+    }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory.
+//	If the table is getting too full to keep probe sequences short,
+//	rehash it into one twice the size first.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
@@ -129,17 +217,25 @@ Directory::Find(char *name)
 bool
 Directory::Add(char *name, int newSector)
 { 
+    int i;
+
     if (FindIndex(name) != -1)
 	return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].sector = newSector;
-        return TRUE;
-	}
-    return FALSE;	// no space.  Fix when we have extensible files.
+    if ((numInUse + numDeleted + 1) * 4 > tableSize * 3)
+        Resize(max(tableSize, 2 * (numInUse + 1)));
+
+    // first entry on the probe sequence that isn't in use
+    for (i = HashName(name) % tableSize; table[i].inUse; i = (i + 1) % tableSize)
+        ;
+    if (table[i].deleted)
+        numDeleted--;
+    table[i].inUse = TRUE;
+    table[i].deleted = FALSE;
+    strncpy(table[i].name, name, FileNameMaxLen); 
+    table[i].sector = newSector;
+    numInUse++;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -158,9 +254,40 @@ Directory::Remove(char *name)
     if (i == -1)
 	return FALSE; 		// name not in directory
     table[i].inUse = FALSE;
+    table[i].deleted = TRUE;
+    numInUse--;
+    numDeleted++;
     return TRUE;	
 }
 
+//----------------------------------------------------------------------
+// Directory::Resize
+// 	Rehash every entry in use into a fresh table of "newSize"
+//	entries, dropping the deleted ones.
+//----------------------------------------------------------------------
+
+void
+Directory::Resize(int newSize)
+{
+    DirectoryEntry *oldTable = table;
+    int oldSize = tableSize, i, j;
+
+    DEBUG('f', "Resizing directory from %d to %d entries\n", oldSize, newSize);
+    table = new DirectoryEntry[newSize];
+    tableSize = newSize;
+    for (i = 0; i < tableSize; i++)
+        table[i].inUse = table[i].deleted = FALSE;
+    for (i = 0; i < oldSize; i++)
+        if (oldTable[i].inUse) {
+            for (j = HashName(oldTable[i].name) % tableSize; table[j].inUse;
+                                                j = (j + 1) % tableSize)
+                ;
+            table[j] = oldTable[i];
+        }
+    numDeleted = 0;
+    delete [] oldTable;
+}
+
 //----------------------------------------------------------------------
 // Directory::List
 // 	List all the file names in the directory. 
@@ -195,3 +322,90 @@ Directory::Print()
     printf("\n");
     delete hdr;
 }
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize an empty lookup cache.
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache()
+{
+    for (int i = 0; i < DentryCacheSize; i++)
+        table[i].valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::SlotOf
+// 	Return the slot that caches looking up "name" in "parent".
+//----------------------------------------------------------------------
+
+int
+DentryCache::SlotOf(int parent, char *name)
+{
+    return ((HashName(name) ^ (unsigned) parent * 2654435761u)
+                                                % DentryCacheSize);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Find
+// 	Look for a cached result of looking up "name" in the directory
+//	whose header is at "parent".  On a hit, return TRUE and set
+//	"sector" to the result, which is -1 if the name isn't there.
+//
+//	Lookups hold the name space lock only shared, so several threads
+//	may use the cache at once; interrupts are turned off to keep
+//	each operation atomic.
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Find(int parent, char *name, int *sector)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    DentryEntry *e = &table[SlotOf(parent, name)];
+    bool hit = e->valid && e->parent == parent
+                        && !strncmp(e->name, name, FileNameMaxLen);
+
+    if (hit)
+        *sector = e->sector;
+    (void) interrupt->SetLevel(oldLevel);
+    DEBUG('D', "Dentry cache %s for \"%s\" in sector %d\n",
+                                    hit ? "hit" : "miss", name, parent);
+    return hit;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember that looking up "name" in "parent" gives "sector"
+//	(-1 if there is no such name), replacing what was cached for it.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(int parent, char *name, int sector)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    DentryEntry *e = &table[SlotOf(parent, name)];
+
+    e->valid = TRUE;
+    e->parent = parent;
+    e->sector = sector;
+    strncpy(e->name, name, FileNameMaxLen);
+    e->name[FileNameMaxLen] = '\0';
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Invalidate
+// 	Forget every lookup done in the directory at "parent"; called
+//	when that directory is removed, since its sector may be reused.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Invalidate(int parent)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    for (int i = 0; i < DentryCacheSize; i++)
+        if (table[i].valid && table[i].parent == parent)
+            table[i].valid = FALSE;
+    (void) interrupt->SetLevel(oldLevel);
+}
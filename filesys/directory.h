@@ -6,6 +6,10 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	The table is a hash table (open addressing, linear probing) on
+//	the name, so lookups don't depend on the size of the directory,
+//	and it doubles in size when it gets 3/4 full.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -36,6 +40,8 @@
 class DirectoryEntry {
   public:
     bool inUse;				// Is this directory entry in use?
+    bool deleted;			// Was it in use, then removed?  Such
+					// entries don't end a probe sequence
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
     char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
@@ -59,13 +65,18 @@ class Directory {
     ~Directory();			// De-allocate the directory
 
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
-    void WriteBack(OpenFile *file);	// Write modifications to 
-					// directory contents back to disk
+    bool WriteBack(OpenFile *file);	// Write modifications to 
+					// directory contents back to disk;
+					// FALSE if the file can't grow
 
     int Find(char *name);		// Find the sector number of the 
 					// FileHeader for file: "name"
+    static int Lookup(OpenFile *file, char *name);
+					// Same, reading only the entries
+					// "name" hashes to from "file"
 
-    bool Add(char *name, int newSector);  // Add a file name into the directory
+    bool Add(char *name, int newSector);  // Add a file name into the directory,
+					// growing it if need be
 
     bool Remove(char *name);		// Remove a file from the directory
 
@@ -79,9 +90,51 @@ class Directory {
     int tableSize;			// Number of directory entries
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
+    int numInUse;			// Entries in use
+    int numDeleted;			// Entries removed since the table
+					// was last rehashed
 
     int FindIndex(char *name);		// Find the index into the directory 
 					//  table corresponding to "name"
+    void Resize(int newSize);		// Rehash into a table of "newSize"
+};
+
+// The following class caches the results of path lookups: for a
+// directory (given by the sector of its file header) and a name, the
+// sector of the named file's header -- or -1, when the name is known
+// not to be there, so that failed lookups are cheap as well.
+//
+// The cache is direct-mapped on a hash of <directory, name>; an entry
+// just replaces whatever was in its slot before.  It is up to the file
+// system to keep it in step with the directories on disk.
+
+#define DentryCacheSize 	128
+
+class DentryEntry {
+  public:
+    bool valid;				// Does this slot hold anything?
+    int parent;				// Sector of the directory's header
+    int sector;				// Sector of the file's header, or
+					// -1 if the name isn't there
+    char name[FileNameMaxLen + 1];	// Name looked up in "parent"
+};
+
+class DentryCache {
+  public:
+    DentryCache();			// Initialize an empty cache
+
+    bool Find(int parent, char *name, int *sector);
+					// Return TRUE and set "sector" if
+					// the lookup result is cached
+    void Enter(int parent, char *name, int sector);
+					// Remember a lookup result
+    void Invalidate(int parent);	// Forget everything looked up in
+					// the directory at "parent"
+
+  private:
+    DentryEntry table[DentryCacheSize];
+
+    int SlotOf(int parent, char *name);	// Where <parent, name> goes
 };
 
 #endif // DIRECTORY_H
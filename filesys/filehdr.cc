@@ -29,6 +29,57 @@
 
 #define LevelMapNum (SectorSize / sizeof(int))
 
+//----------------------------------------------------------------------
+// FileHeader::FileHeader
+// 	Nothing is known about the file yet, so no index blocks are
+//	cached, and no sectors are reserved.
+//----------------------------------------------------------------------
+
+FileHeader::FileHeader()
+{
+    headerSector = -1;
+    dirty = FALSE;
+    runLeft = 0;
+    indirectIndex = doubleIndirectIndex = NULL;
+    for (int i = 0; i < LevelMapNum; i++)
+        secondLevelIndex[i] = NULL;
+    DropIndex();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::~FileHeader
+// 	Free the cached index blocks.  Any changes to them were already
+//	written back by ExpandFileSize.
+//----------------------------------------------------------------------
+
+FileHeader::~FileHeader()
+{
+    DropIndex();
+}
+
+//----------------------------------------------------------------------
+// IndexSectors
+// 	Return how many index blocks have to be allocated when a file
+//	grows from "from" to "to" data sectors.  The first sector past
+//	the single indirect block needs two: the double indirect block,
+//	and the first second-level block under it.
+//----------------------------------------------------------------------
+
+static int
+IndexSectors(int from, int to)
+{
+    int count = 0;
+
+    for (int k = from; k < to; k++) {
+        int j = k - NumDirect - LevelMapNum;
+        if (j == 0)
+            count += 2;
+        else if (k == NumDirect || (j > 0 && j % LevelMapNum == 0))
+            count++;
+    }
+    return count;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -43,67 +94,118 @@
 bool
 FileHeader::Allocate(BitMap *freeMap, int fileSize)
 { 
+    DropIndex();			// index blocks are written directly
     numBytes = fileSize;
     numSectors  = divRoundUp(fileSize, SectorSize);
-    if (freeMap->NumClear() < numSectors)
+    int sectorsNeeded = numSectors + IndexSectors(0, numSectors);
+    int freeBefore = freeMap->NumClear();
+    if (freeBefore < sectorsNeeded)
 	    return FALSE;		// not enough space
+    ReserveRun(freeMap, sectorsNeeded, 0);
 
     // 直接索引就够用
-    if (numSectors < NumDirect) {
+    if (numSectors <= NumDirect) {
         //DEBUG('f', COLORED(OKGREEN, "Allocating using direct indexing only\n"));
         for (int i = 0; i < numSectors; i++)
-            dataSectors[i] = freeMap->Find();
+            dataSectors[i] = TakeSector(freeMap);
     }else {
         //文件长度小于7*128+32*128时，使用直接索引+二级索引
-        if (numSectors < (NumDirect + LevelMapNum)) {
+        if (numSectors <= (NumDirect + LevelMapNum)) {
             DEBUG('f', "Allocating using single indirect indexing\n");
             // 直接索引
             for (int i = 0; i < NumDirect; i++)
-                dataSectors[i] = freeMap->Find();
+                dataSectors[i] = TakeSector(freeMap);
             // 二级索引
-            dataSectors[IndirectSectorIdx] = freeMap->Find();
-            int indirectIndex[LevelMapNum];
+            dataSectors[IndirectSectorIdx] = TakeSector(freeMap);
+            int indexBuf[LevelMapNum];
             for (int i = 0; i < numSectors - NumDirect; i++) {
-                indirectIndex[i] = freeMap->Find();
+                indexBuf[i] = TakeSector(freeMap);
             }
-            synchDisk->WriteSector(dataSectors[IndirectSectorIdx], (char*)indirectIndex);
+            synchDisk->WriteSector(dataSectors[IndirectSectorIdx], (char*)indexBuf);
             //文件长度小于7*128+32*128+32*32*128时，使用直接索引+二级索引+三级索引
-        } else if (numSectors < (NumDirect + LevelMapNum + LevelMapNum*LevelMapNum)) {
+        } else if (numSectors <= (NumDirect + LevelMapNum + LevelMapNum*LevelMapNum)) {
             DEBUG('f',"Allocating using double indirect indexing\n");
             // 直接索引
             for (int i = 0; i < NumDirect; i++)
-                dataSectors[i] = freeMap->Find();
-            dataSectors[IndirectSectorIdx] = freeMap->Find();
+                dataSectors[i] = TakeSector(freeMap);
+            dataSectors[IndirectSectorIdx] = TakeSector(freeMap);
             // 二级索引
-            int indirectIndex[LevelMapNum];
+            int indexBuf[LevelMapNum];
             for (int i = 0; i < LevelMapNum; i++) {
-                indirectIndex[i] = freeMap->Find();
+                indexBuf[i] = TakeSector(freeMap);
             }
-            synchDisk->WriteSector(dataSectors[IndirectSectorIdx], (char*)indirectIndex);
+            synchDisk->WriteSector(dataSectors[IndirectSectorIdx], (char*)indexBuf);
             // 三级索引
-            dataSectors[DoubleIndirectSectorIdx] = freeMap->Find();
+            dataSectors[DoubleIndirectSectorIdx] = TakeSector(freeMap);
             const int sectorsLeft = numSectors - NumDirect - LevelMapNum;
             const int secondIndirectNum = divRoundUp(sectorsLeft, LevelMapNum);
-            int doubleIndirectIndex[LevelMapNum];
+            int doubleIndexBuf[LevelMapNum];
             
             for (int j = 0; j < secondIndirectNum; j++) {
-                doubleIndirectIndex[j] = freeMap->Find();
+                doubleIndexBuf[j] = TakeSector(freeMap);
                 int singleIndirectIndex[LevelMapNum];
                 for (int i = 0; (i < LevelMapNum) && (i + j * LevelMapNum < sectorsLeft); i++) {
-                    singleIndirectIndex[i] = freeMap->Find();
+                    singleIndirectIndex[i] = TakeSector(freeMap);
                 }
-                synchDisk->WriteSector(doubleIndirectIndex[j], (char*)singleIndirectIndex);
+                synchDisk->WriteSector(doubleIndexBuf[j], (char*)singleIndirectIndex);
             }
-            synchDisk->WriteSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndirectIndex);
+            synchDisk->WriteSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndexBuf);
         } else {//超出文件最大长度，无法存储
             ASSERT(FALSE);
         }
     }
     // for (int i = 0; i < numSectors; i++)
 	//     dataSectors[i] = freeMap->Find();
+    ReleaseRun(freeMap);
+    ASSERT(freeBefore - freeMap->NumClear() == sectorsNeeded);
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::ReserveRun
+// 	Try to reserve "count" consecutive free sectors, at or after
+//	"hint" if possible, for TakeSector to hand out in order.  If there
+//	is no such run, TakeSector will go sector by sector instead.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ReserveRun(BitMap *bitMap, int count, int hint)
+{
+    runNext = bitMap->FindRange(count, hint);
+    runLeft = (runNext == -1) ? 0 : count;
+    lastTaken = hint - 1;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TakeSector
+// 	Return the next sector to allocate: the next one of the reserved
+//	run, or else the first free sector after the one taken last.
+//----------------------------------------------------------------------
+
+int
+FileHeader::TakeSector(BitMap *bitMap)
+{
+    if (runLeft > 0) {
+        runLeft--;
+        lastTaken = runNext++;
+    } else
+        lastTaken = bitMap->FindNear(lastTaken + 1);
+    ASSERT(lastTaken != -1);
+    return lastTaken;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReleaseRun
+// 	Give back the reserved sectors that weren't taken after all.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ReleaseRun(BitMap *bitMap)
+{
+    for (; runLeft > 0; runLeft--)
+        bitMap->Clear(runNext++);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
 // 	De-allocate all the space allocated for data blocks for this file.
@@ -135,16 +237,16 @@ FileHeader::Deallocate(BitMap *freeMap)
         //回收三级索引存储下的文件
         if (numSectors > NumDirect + LevelMapNum) {
             DEBUG('f',"Deallocating double indirect indexing table\n");
-            int doubleIndirectIndex[LevelMapNum];
-            synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndirectIndex);
+            int doubleIndexBuf[LevelMapNum];
+            synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndexBuf);
             for (i = NumDirect + LevelMapNum, ii = 0; (i < numSectors) && (ii < LevelMapNum); ii++) {
-                synchDisk->ReadSector(doubleIndirectIndex[ii], (char*)singleIndirectIndex);
+                synchDisk->ReadSector(doubleIndexBuf[ii], (char*)singleIndirectIndex);
                 for (iii = 0; (i < numSectors) && (iii < LevelMapNum); i++, iii++) {
                     ASSERT(freeMap->Test((int)singleIndirectIndex[iii])); 
                     freeMap->Clear((int)singleIndirectIndex[iii]);
                 }
-                ASSERT(freeMap->Test((int)doubleIndirectIndex[ii]));
-                freeMap->Clear((int)doubleIndirectIndex[ii]);
+                ASSERT(freeMap->Test((int)doubleIndexBuf[ii]));
+                freeMap->Clear((int)doubleIndexBuf[ii]);
             }
             ASSERT(freeMap->Test((int)dataSectors[DoubleIndirectSectorIdx]));
             freeMap->Clear((int)dataSectors[DoubleIndirectSectorIdx]);
@@ -154,7 +256,8 @@ FileHeader::Deallocate(BitMap *freeMap)
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk. 
+// 	Fetch contents of file header from disk.  Readers share the
+//	header sector, so many threads can fetch the same header at once.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
@@ -162,7 +265,11 @@ FileHeader::Deallocate(BitMap *freeMap)
 void
 FileHeader::FetchFrom(int sector)
 {
+    DropIndex();			// they belonged to the old contents
+    synchDisk->PlusReader(sector);
     synchDisk->ReadSector(sector, (char *)this);
+    synchDisk->MinusReader(sector);
+    dirty = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -175,7 +282,12 @@ FileHeader::FetchFrom(int sector)
 void
 FileHeader::WriteBack(int sector)
 {
+    synchDisk->BeginTransaction();		// on its own, if need be
+    synchDisk->BeginWrite(sector);
     synchDisk->WriteSector(sector, (char *)this); 
+    synchDisk->EndWrite(sector);
+    synchDisk->EndTransaction();
+    dirty = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -200,17 +312,110 @@ FileHeader::ByteToSector(int offset)
         return (dataSectors[offset / SectorSize]);
     } else if (offset < singleIndirectMapSize) {
         const int sectorNum = (offset - directMapSize) / SectorSize;
-        int singleIndirectIndex[LevelMapNum];
-        synchDisk->ReadSector(dataSectors[IndirectSectorIdx], (char*)singleIndirectIndex);
-        return singleIndirectIndex[sectorNum];
+        return IndirectBlock()[sectorNum];
     } else {
         const int indexSectorNum = (offset - singleIndirectMapSize) / SectorSize / LevelMapNum;
         const int sectorNum = (offset - singleIndirectMapSize) / SectorSize % LevelMapNum;
-        int doubleIndirectIndex[LevelMapNum]; 
-        synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndirectIndex);
-        int singleIndirectIndex[LevelMapNum]; 
-        synchDisk->ReadSector(doubleIndirectIndex[indexSectorNum], (char*)singleIndirectIndex);
-        return singleIndirectIndex[sectorNum];
+        return SecondLevelBlock(indexSectorNum)[sectorNum];
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::IndirectBlock, DoubleIndirectBlock, SecondLevelBlock
+// 	Return the cached copy of an index block, reading it from disk
+//	the first time.
+//
+//	The in-core header is shared by everyone who has the file open,
+//	and the read may wait for the disk: the block is only cached once
+//	it has been read, so nobody else sees it half filled in.  If
+//	someone else read it meanwhile, theirs is kept.
+//
+//	"i" is which entry of the double indirect block to follow
+//----------------------------------------------------------------------
+
+int *
+FileHeader::IndirectBlock()
+{
+    if (indirectIndex == NULL)
+        indirectIndex = LoadIndex(dataSectors[IndirectSectorIdx],
+                                    &indirectIndex);
+    return indirectIndex;
+}
+
+int *
+FileHeader::DoubleIndirectBlock()
+{
+    if (doubleIndirectIndex == NULL)
+        doubleIndirectIndex = LoadIndex(dataSectors[DoubleIndirectSectorIdx],
+                                    &doubleIndirectIndex);
+    return doubleIndirectIndex;
+}
+
+int *
+FileHeader::SecondLevelBlock(int i)
+{
+    if (secondLevelIndex[i] == NULL)
+        secondLevelIndex[i] = LoadIndex(DoubleIndirectBlock()[i],
+                                    &secondLevelIndex[i]);
+    return secondLevelIndex[i];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::LoadIndex
+// 	Read the index block in "sector", and return it -- or, if "*cached"
+//	was filled in while we waited for the disk, that instead.
+//----------------------------------------------------------------------
+
+int *
+FileHeader::LoadIndex(int sector, int **cached)
+{
+    int *block = new int[LevelMapNum];
+
+    synchDisk->ReadSector(sector, (char*)block);
+    if (*cached != NULL) {
+        delete [] block;
+        return *cached;
+    }
+    return block;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::WriteBackIndex
+// 	Write the cached index blocks that have changed back to disk.
+//----------------------------------------------------------------------
+
+void
+FileHeader::WriteBackIndex()
+{
+    if (indirectDirty)
+        synchDisk->WriteSector(dataSectors[IndirectSectorIdx], (char*)indirectIndex);
+    if (doubleIndirectDirty)
+        synchDisk->WriteSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndirectIndex);
+    for (int i = 0; i < LevelMapNum; i++)
+        if (secondLevelDirty[i])
+            synchDisk->WriteSector(doubleIndirectIndex[i], (char*)secondLevelIndex[i]);
+    indirectDirty = doubleIndirectDirty = FALSE;
+    for (int i = 0; i < LevelMapNum; i++)
+        secondLevelDirty[i] = FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DropIndex
+// 	Forget the cached index blocks, e.g. because the header is about
+//	to be overwritten.
+//----------------------------------------------------------------------
+
+void
+FileHeader::DropIndex()
+{
+    delete [] indirectIndex;
+    delete [] doubleIndirectIndex;
+    indirectIndex = doubleIndirectIndex = NULL;
+    indirectDirty = doubleIndirectDirty = FALSE;
+    for (int i = 0; i < LevelMapNum; i++) {
+        delete [] secondLevelIndex[i];
+        secondLevelIndex[i] = NULL;
+        secondLevelDirty[i] = FALSE;
     }
 }
 
@@ -237,10 +442,14 @@ FileHeader::Print()
     int i, j, k;
     char *data = new char[SectorSize];
     printf("--------------------- %s ----------------------\n", "FileHeader contents");
+    time_t t;
     printf("\tFileType type: %s\n", fileType);
-    printf("\tCreated: %s ", createdTime);
-    printf("\tModified: %s ", modifiedTime);
-    printf("\tLast Visited Time: %s ", lastVisitedTime);
+    t = createdTime;
+    printf("\tCreated: %s ", ctime(&t));   // ctime ends in '\n'
+    t = modifiedTime;
+    printf("\tModified: %s ", ctime(&t));
+    t = lastVisitedTime;
+    printf("\tLast Visited Time: %s ", ctime(&t));
     // printf("\tPath: %s\n", filePath);
 
     printf("File size: %d.  File blocks:\n", numBytes);
@@ -248,7 +457,7 @@ FileHeader::Print()
     // 与上面的对应
     int ii, iii;
     int singleIndirectIndex[LevelMapNum];
-    int doubleIndirectIndex[LevelMapNum];
+    int doubleIndexBuf[LevelMapNum];
     printf("\tDirect indexing:\n\t");
 
     for (i = 0; (i < numSectors) && (i < NumDirect); i++)
@@ -261,10 +470,10 @@ FileHeader::Print()
             printf("%d ", singleIndirectIndex[ii]);
         if (numSectors > NumDirect + LevelMapNum) {
             printf("\n  Double indirect indexing: (mapping table sector: %d)", dataSectors[DoubleIndirectSectorIdx]);
-            synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndirectIndex);
+            synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndexBuf);
             for (i = NumDirect + LevelMapNum, ii = 0; (i < numSectors) && (ii < LevelMapNum); ii++) {
-                printf("\n    single indirect indexing: (mapping table sector: %d)\n      ", doubleIndirectIndex[ii]);
-                synchDisk->ReadSector(doubleIndirectIndex[ii], (char*)singleIndirectIndex);
+                printf("\n    single indirect indexing: (mapping table sector: %d)\n      ", doubleIndexBuf[ii]);
+                synchDisk->ReadSector(doubleIndexBuf[ii], (char*)singleIndirectIndex);
                 for (iii = 0;  (i < numSectors) && (iii < LevelMapNum); i++, iii++)
                     printf("%d ", singleIndirectIndex[iii]);
             }
@@ -288,9 +497,9 @@ FileHeader::Print()
             printf("\n");
         }
         if (numSectors > NumDirect + LevelMapNum) {
-            synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndirectIndex);
+            synchDisk->ReadSector(dataSectors[DoubleIndirectSectorIdx], (char*)doubleIndexBuf);
             for (i = NumDirect + LevelMapNum, ii = 0; (i < numSectors) && (ii < LevelMapNum); ii++) {
-                synchDisk->ReadSector(doubleIndirectIndex[ii], (char*)singleIndirectIndex);
+                synchDisk->ReadSector(doubleIndexBuf[ii], (char*)singleIndirectIndex);
                 for (iii = 0; (i < numSectors) && (iii < LevelMapNum); i++, iii++) {
                     synchDisk->ReadSector(singleIndirectIndex[iii], data);
                     for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++)
@@ -334,18 +543,14 @@ getFileExtension(char *filename)
 
 //----------------------------------------------------------------------
 // getCurrentTime
-//    Return the sting of the time that we called it.
-//
-//    (use asctime to transfer to string)
+//    Return the time that we called it, in seconds since the epoch.
+//    It is only turned into a string by FileHeader::Print.
 //----------------------------------------------------------------------
 
-char*
+int
 getCurrentTime(void)
 {
-    time_t rawtime;
-    time(&rawtime);
-    struct tm* currentTime = localtime(&rawtime);
-    return asctime(currentTime); // This somehow will generate extra '\n'
+    return (int) time(NULL);
 }
 
 //----------------------------------------------------------------------
@@ -359,11 +564,45 @@ void
 FileHeader::HeaderCreateInit(char* ext)
 {
     setFileType(ext);
+    createdTime = modifiedTime = lastVisitedTime = getCurrentTime();
+    dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FileAccessed/FileModified
+//  Update the access or modify time after a read or write.  Only the
+//  in-core header changes; it reaches the disk when the file is last
+//  closed.  The header is only dirtied when a time actually changes,
+//  and, as with relatime, a read only moves the access time if it is
+//  older than the last modification or than "accessTimeDelay" seconds,
+//  so a file that is just being read rarely needs its header written.
+//----------------------------------------------------------------------
+
+int accessTimeDelay = DefaultAccessTimeDelay;
+
+void
+FileHeader::FileAccessed()
+{
+    int now = getCurrentTime();
+
+    if (lastVisitedTime <= modifiedTime
+                || now - lastVisitedTime >= accessTimeDelay) {
+        if (lastVisitedTime != now) {
+            lastVisitedTime = now;
+            dirty = TRUE;
+        }
+    }
+}
+
+void
+FileHeader::FileModified()
+{
+    int now = getCurrentTime();
 
-    char* currentTimeString = getCurrentTime();
-    setCreateTime(currentTimeString);
-    setModifyTime(currentTimeString);
-    setVisitTime(currentTimeString);
+    if (modifiedTime != now) {
+        modifiedTime = now;
+        dirty = TRUE;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -403,10 +642,10 @@ FilePath pathParser(char* path) {
 // FileHeader::ExpandFileSize
 // 	Reallocate the file size for additionalBytes
 //----------------------------------------------------------------------
-#define INDIRECT_MAP
 bool FileHeader::ExpandFileSize(BitMap* freeMap, int additionalBytes) {
     ASSERT(additionalBytes > 0);
     numBytes += additionalBytes;
+    dirty = TRUE;
     // 获取增长前扇区的数量
     int initSector = numSectors;
     // 计算增长后扇区的数量
@@ -416,30 +655,56 @@ bool FileHeader::ExpandFileSize(BitMap* freeMap, int additionalBytes) {
         return TRUE; // no need more sector
     }
     int sectorsToExpand = numSectors - initSector;
-    if (freeMap->NumClear() < sectorsToExpand) {
+    // 索引块也要占用扇区
+    int indexSectors = IndexSectors(initSector, numSectors);
+    int freeBefore = freeMap->NumClear();
+    if (freeBefore < sectorsToExpand + indexSectors) {
         // 没有空间
+        numBytes -= additionalBytes;
+        numSectors = initSector;
         return FALSE; // no more space to allocate
     }
 
     DEBUG('f', COLORED(OKGREEN, "Expanding file size for %d sectors (%d bytes)\n"), sectorsToExpand, additionalBytes);
 
-    if (numSectors < NumDirect) { // just like FileHeader::Allocate
-        // 有空间则继续分配
-        for (int i = initSector; i < numSectors; i++)
-            dataSectors[i] = freeMap->Find();
-    } else {
-#ifndef INDIRECT_MAP
-        ASSERT_MSG(FALSE, "File size exceeded the maximum representation of the direct map");
-#else
-
-// TODO: Expand file size in indirect mapping mode
-
-        if (numSectors < (NumDirect + LevelMapNum)) {
-        } else if (numSectors < (NumDirect + LevelMapNum + LevelMapNum*LevelMapNum)) {
+    // just like FileHeader::Allocate, but one sector at a time, and
+    // through the cached index blocks.  Grow in place if we can: start
+    // right after the last data sector (or the header, if none).
+    int hint = (initSector > 0) ? ByteToSector((initSector - 1) * SectorSize) + 1
+                                : headerSector + 1;
+    ReserveRun(freeMap, sectorsToExpand + indexSectors, hint);
+    for (int k = initSector; k < numSectors; k++) {
+        if (k < NumDirect) {
+            dataSectors[k] = TakeSector(freeMap);
+        } else if (k < NumDirect + LevelMapNum) {
+            // 二级索引
+            if (k == NumDirect) {
+                dataSectors[IndirectSectorIdx] = TakeSector(freeMap);
+                indirectIndex = new int[LevelMapNum];
+            }
+            IndirectBlock()[k - NumDirect] = TakeSector(freeMap);
+            indirectDirty = TRUE;
+        } else if (k < NumDirect + LevelMapNum + LevelMapNum*LevelMapNum) {
+            // 三级索引
+            const int j = k - NumDirect - LevelMapNum;
+            const int ii = j / LevelMapNum;
+            if (j == 0) {
+                dataSectors[DoubleIndirectSectorIdx] = TakeSector(freeMap);
+                doubleIndirectIndex = new int[LevelMapNum];
+            }
+            if (j % LevelMapNum == 0) {
+                DoubleIndirectBlock()[ii] = TakeSector(freeMap);
+                doubleIndirectDirty = TRUE;
+                secondLevelIndex[ii] = new int[LevelMapNum];
+            }
+            SecondLevelBlock(ii)[j % LevelMapNum] = TakeSector(freeMap);
+            secondLevelDirty[ii] = TRUE;
         } else {
             ASSERT_MSG(FALSE, "File size exceeded the maximum representation of the double indirect mapping");
         }
-#endif
     }
+    ReleaseRun(freeMap);
+    ASSERT(freeBefore - freeMap->NumClear() == sectorsToExpand + indexSectors);
+    WriteBackIndex();
     return TRUE;
 }
\ No newline at end of file
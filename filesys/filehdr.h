@@ -36,11 +36,16 @@
 
 
 // Disk part
-#define NumOfIntHeaderInfo 2
+// 时间以整数秒保存，只在 Print 时才格式化成字符串
 #define NumOfTimeHeaderInfo 3
-#define LengthOfTimeHeaderStr 26 // 25 + 1 ('/0')
+#define NumOfIntHeaderInfo (2 + NumOfTimeHeaderInfo)
 #define MaxExtLength 5           // 4  + 1 ('/0')
-#define LengthOfAllString MaxExtLength + NumOfTimeHeaderInfo*LengthOfTimeHeaderStr
+#define LengthOfAllString MaxExtLength
+
+// A read only updates the access time if it is older than the last
+// modification, or older than this many seconds (cf. relatime)
+#define DefaultAccessTimeDelay (24 * 60 * 60)
+extern int accessTimeDelay;		// set by "-at"
 
 //直接索引个数，添加晚上上述信息之后，索引将由原来的30个变为9个
 // #define NumDirect 	((SectorSize - (NumOfIntHeaderInfo*sizeof(int) + LengthOfAllString*sizeof(char))) / sizeof(int))
@@ -56,12 +61,26 @@
 // as one disk sector.  Without indirect addressing, this
 // limits the maximum file length to just under 4K bytes.
 //
-// There is no constructor; rather the file header can be initialized
-// by allocating blocks for the file (if it is a new file), or by
-// reading it from disk.
+// The constructor doesn't set up the header; rather the file header can
+// be initialized by allocating blocks for the file (if it is a new file),
+// or by reading it from disk.
+//
+// Sectors are allocated in runs: Allocate and ExpandFileSize first
+// try to reserve all the sectors they need (data and index blocks) as
+// one contiguous stretch of the disk, and otherwise take each sector as
+// close after the previous one as possible.  A file written or copied
+// in one go thus lies sequentially on its tracks.
+//
+// The in-core header also keeps the indirect index blocks it has read,
+// so looking up a block of a large file costs no disk reads after the
+// first.  They are loaded lazily, and written back by ExpandFileSize,
+// the only thing that changes them once the file exists.
 
 class FileHeader {
   public:
+    FileHeader();			// Start with no index blocks cached
+    ~FileHeader();			// Free the cached index blocks
+
     bool Allocate(BitMap *bitMap, int fileSize);// Initialize a file header, 
 						//  including allocating space 
 						//  on disk for the file data
@@ -84,13 +103,14 @@ class FileHeader {
     // Lab5: additional file attributes
     void HeaderCreateInit(char* ext); // Initialize all header message for creation
     // Disk part
-    void setFileType(char* ext) { strcmp(ext, "") ? strcpy(fileType, ext) : strcpy(fileType, "None"); }
-    void setCreateTime(char* t) { strcpy(createdTime, t); }
-    void setModifyTime(char* t) { strcpy(modifiedTime, t); }
-    void setVisitTime(char* t) { strcpy(lastVisitedTime, t); }
+    void setFileType(char* ext) { strcmp(ext, "") ? strcpy(fileType, ext) : strcpy(fileType, "None"); dirty = TRUE; }
+    void FileAccessed();		// Note a read (maybe updating the
+					// access time) or a write (the
+    void FileModified();		// modify time), in core only
     // In-core part
     void setHeaderSector(int sector) { headerSector = sector; }
     int getHeaderSector() { return headerSector; }
+    bool IsDirty() { return dirty; }	// changed since read or written?
 
     char* getFileType() { return strdup(fileType); }
 
@@ -98,7 +118,7 @@ class FileHeader {
     bool ExpandFileSize(BitMap *freeMap, int additionalBytes);
 
     int getNumBytes() { return numBytes; }
-    void setNumBytes(int n) { numBytes = n; }
+    void setNumBytes(int n) { numBytes = n; dirty = TRUE; }
 
   private:
     // ======================== Disk Part ======================== //
@@ -107,10 +127,10 @@ class FileHeader {
     int numSectors; // Number of data sectors in the file
 
     // Lab5: additional file attributes
+    int createdTime;     // Seconds since the epoch
+    int modifiedTime;
+    int lastVisitedTime;
     char fileType[MaxExtLength];
-    char createdTime[LengthOfTimeHeaderStr];
-    char modifiedTime[LengthOfTimeHeaderStr];
-    char lastVisitedTime[LengthOfTimeHeaderStr];
 
     // == Data Sectors == //
     // int dataSectors[NumDirect]; // Disk sector numbers for each data
@@ -121,12 +141,38 @@ class FileHeader {
     int headerSector; // Because when we OpenFile, we need to update the header information
                       // but the sector message is only exist when create the OpenFile object
                       // some how we need to know which sector to write back
+    bool dirty;				// header differs from the disk copy
+
+    // Cached index blocks, NULL until first needed
+    int *indirectIndex;			// the single indirect block
+    int *doubleIndirectIndex;		// the double indirect block
+    int *secondLevelIndex[SectorSize / sizeof(int)];
+					// blocks it points to
+    bool indirectDirty;			// changed since read from disk?
+    bool doubleIndirectDirty;
+    bool secondLevelDirty[SectorSize / sizeof(int)];
+
+    int *IndirectBlock();		// load on demand
+    int *DoubleIndirectBlock();
+    int *SecondLevelBlock(int i);
+    int *LoadIndex(int sector, int **cached);
+    void WriteBackIndex();		// write back the dirty ones
+    void DropIndex();			// forget all cached index blocks
+
+    // Allocation state, so that a file's sectors end up contiguous
+    int runNext;			// next sector of the reserved run
+    int runLeft;			// sectors left in it
+    int lastTaken;			// sector handed out last
+
+    void ReserveRun(BitMap *bitMap, int count, int hint);
+    int TakeSector(BitMap *bitMap);	// next sector, in disk order
+    void ReleaseRun(BitMap *bitMap);	// give back what wasn't taken
 };
 
 char* printChar(char oriChar);
 
 extern char* getFileExtension(char *filename);
-extern char* getCurrentTime(void);
+extern int getCurrentTime(void);
 
 typedef struct {
     char* dirArray[MAX_DIR_DEPTH];
@@ -50,6 +50,7 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "synch.h"
 #include "system.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
@@ -58,6 +59,8 @@
 #define FreeMapSector 		0
 #define DirectorySector 	1
 #define PipeSector          2
+#define JournalSector		3	// first of JournalSectors
+#define JournalSectors		64	// sectors holding the journal
 
 // Initial file sizes for the bitmap and directory; until the file system
 // supports extensible files, the directory size sets the maximum number 
@@ -87,8 +90,12 @@
 FileSystem::FileSystem(bool format)
 { 
     DEBUG('f', "Initializing the file system.\n");
+    namespaceLock = new RWLock("namespace lock");
+    dentryCache = new DentryCache;
+    freeMapLock = new Lock("free map lock");
+    freeMap = new BitMap(NumSectors);
+    Journal *journal = new Journal(JournalSector, JournalSectors);
     if (format) {
-        BitMap *freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
 
         FileHeader *mapHdr = new FileHeader;
@@ -104,6 +111,8 @@ FileSystem::FileSystem(bool format)
         freeMap->Mark(FreeMapSector);	    
         freeMap->Mark(DirectorySector);
         freeMap->Mark(PipeSector);
+        for (int i = 0; i < JournalSectors; i++)
+            freeMap->Mark(JournalSector + i);
 
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
@@ -138,23 +147,60 @@ FileSystem::FileSystem(bool format)
         freeMap->WriteBack(freeMapFile);	 // flush changes to disk
         directory->WriteBack(directoryFile);
 
+        // From now on, metadata updates go through the journal
+        journal->Format();
+        synchDisk->SetJournal(journal);
+
         if (DebugIsEnabled('f')) {
             freeMap->Print();
             directory->Print();
 
-            delete freeMap; 
             delete directory; 
             delete mapHdr; 
             delete dirHdr;
 	    }
     } else {
+        // first finish whatever was committed before we last stopped
+        if (journal->Mount())
+            synchDisk->SetJournal(journal);
+        else {
+            DEBUG('f', "No journal on disk, not logging updates.\n");
+            delete journal;
+        }
+
         // if we are not formatting the disk, just open the files representing
         // the bitmap and directory; these are left open while Nachos is running
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap->FetchFrom(freeMapFile);
     }
 }
 
+//----------------------------------------------------------------------
+// FileSystem::AcquireFreeMap/ReleaseFreeMap
+// 	The bitmap of free sectors stays in memory while Nachos is
+//	running.  Whoever allocates or frees sectors acquires it, changes
+//	it, and releases it; only the sectors of the bitmap file that
+//	changed are then written back.
+//
+//	Nothing that might grow a file (and so acquire the map itself)
+//	may be done while holding it.
+//----------------------------------------------------------------------
+
+BitMap *
+FileSystem::AcquireFreeMap()
+{
+    freeMapLock->Acquire();
+    return freeMap;
+}
+
+void
+FileSystem::ReleaseFreeMap()
+{
+    freeMap->WriteBackDirty(freeMapFile);
+    freeMapLock->Release();
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
@@ -177,8 +223,8 @@ FileSystem::FileSystem(bool format)
 //	 	no free entry for file in directory
 //	 	no free space for data blocks for the file 
 //
-// 	Note that this implementation assumes there is no concurrent access
-//	to the file system!
+// 	Directories are modified under exclusive access to the name space,
+//	so concurrent lookups never see a half-updated directory.
 //
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
@@ -188,7 +234,6 @@ bool
 FileSystem::Create(char *name, int initialSize)
 {
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *hdr;
     int sector;
     bool success;
@@ -204,13 +249,15 @@ FileSystem::Create(char *name, int initialSize)
 #endif
     DEBUG('f', "Creating file %s, size %d\n", name, initialSize);
 
+    namespaceLock->AcquireWrite();
+    synchDisk->BeginTransaction();
     directory = new Directory(NumDirEntries);
 #ifndef MULTI_LEVEL_DIR
     directory->FetchFrom(directoryFile);
 #else
-    int dirSector = FindDirSector(name);
+    int dirSector = LookupDirSector(name);
     ASSERT_MSG(dirSector != -1, "Make sure you create file/dir in the existing directory.");
-    OpenFile* dirFile = new OpenFile(dirSector);
+    OpenFile* dirFile = OpenDirFile(dirSector);
     directory->FetchFrom(dirFile);
     FilePath filepath = pathParser(name);
     if (filepath.dirDepth > 0) {
@@ -222,21 +269,24 @@ FileSystem::Create(char *name, int initialSize)
         success = FALSE; // file is already in directory
     else
     {
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
+        AcquireFreeMap();
         sector = freeMap->Find(); // find a sector to hold the file header
-        if (sector == -1)
+        if (sector == -1) {
             success = FALSE; // no free block for file header
-        else if (!directory->Add(name, sector))
+            ReleaseFreeMap();
+        } else if (!directory->Add(name, sector)) {
             success = FALSE; // no space in directory
-        else
+            freeMap->Clear(sector);
+            ReleaseFreeMap();
+        } else
         {
             hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize))
+            if (!hdr->Allocate(freeMap, initialSize)) {
                 success = FALSE; // no space on disk for data
-            else
+                freeMap->Clear(sector);
+                ReleaseFreeMap();
+            } else
             {
-                success = TRUE;
 #ifdef MULTI_LEVEL_DIR
                 if (isDir)
                     hdr->HeaderCreateInit(DirFileExt);
@@ -245,8 +295,11 @@ FileSystem::Create(char *name, int initialSize)
                 hdr->HeaderCreateInit(getFileExtension(name)); // Lab5: additional file attributes
                 // everthing worked, flush all changes back to disk
                 hdr->WriteBack(sector);
+                // let go of the free map first: writing the
+                // directory back may grow it, which needs the map
+                ReleaseFreeMap();
 #ifndef MULTI_LEVEL_DIR
-                directory->WriteBack(directoryFile);
+                success = directory->WriteBack(directoryFile);
 #else
                 if(isDir) {
                     Directory* dir = new Directory(NumDirEntries);
@@ -255,16 +308,28 @@ FileSystem::Create(char *name, int initialSize)
                     delete dir;
                     delete subDirFile;
                 }
-                directory->WriteBack(dirFile);
-                delete dirFile;
+                success = directory->WriteBack(dirFile);
+                if (success)
+                    dentryCache->Enter(dirSector, name, sector);
 #endif
-                freeMap->WriteBack(freeMapFile);
+                if (!success) {
+                    // no space to grow the directory: give the
+                    // new file's sectors back
+                    AcquireFreeMap();
+                    hdr->Deallocate(freeMap);
+                    freeMap->Clear(sector);
+                    ReleaseFreeMap();
+                }
             }
             delete hdr;
         }
-        delete freeMap;
     }
     delete directory;
+#ifdef MULTI_LEVEL_DIR
+    CloseDirFile(dirFile);
+#endif
+    synchDisk->EndTransaction();
+    namespaceLock->ReleaseWrite();
     return success;
 }
 
@@ -281,25 +346,32 @@ FileSystem::Create(char *name, int initialSize)
 OpenFile *
 FileSystem::Open(char *name)
 { 
+#ifndef MULTI_LEVEL_DIR
     Directory *directory;
+#endif
     OpenFile *openFile = NULL;
     int sector;
 
     DEBUG('f', "Opening file %s\n", name);
+    namespaceLock->AcquireRead();
 #ifndef MULTI_LEVEL_DIR
     directory = new Directory(NumDirEntries);
     directory->FetchFrom(directoryFile);
+    sector = directory->Find(name);
+    delete directory;
 #else
-    directory = (Directory*)FindDir(name);
+    int dirSector = LookupDirSector(name);
     FilePath filepath = pathParser(name);
     if (filepath.dirDepth > 0) {
         name = filepath.base;
     }
+    sector = -1;
+    if (dirSector != -1)
+        sector = LookupName(dirSector, name);
 #endif
-    sector = directory->Find(name);
     if (sector >= 0)
 	    openFile = new OpenFile(sector);	// name was found in directory 
-    delete directory;
+    namespaceLock->ReleaseRead();
     return openFile;				// return NULL if not found
 }
 
@@ -322,21 +394,31 @@ bool
 FileSystem::Remove(char *name)
 { 
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *fileHdr;
     int sector;
     
-    directory = (Directory*)FindDir(name);
+    namespaceLock->AcquireWrite();
+    synchDisk->BeginTransaction();
+    int dirSector = LookupDirSector(name);
+    if (dirSector == -1) {
+       synchDisk->EndTransaction();
+       namespaceLock->ReleaseWrite();
+       return FALSE;			 // no such directory
+    }
+    OpenFile *dirFile = OpenDirFile(dirSector);
+    directory = new Directory(NumDirEntries);
+    directory->FetchFrom(dirFile);
     FilePath filePath = pathParser(name);
     if (filePath.dirDepth > 0) {
         name = filePath.base;
     }
-    // directory = new Directory(NumDirEntries);
-    // directory->FetchFrom(directoryFile);
     
     sector = directory->Find(name);
     if (sector == -1) {
        delete directory;
+       CloseDirFile(dirFile);
+       synchDisk->EndTransaction();
+       namespaceLock->ReleaseWrite();
        return FALSE;			 // file not found 
     }
 
@@ -347,25 +429,35 @@ FileSystem::Remove(char *name)
         DEBUG('D', "Reject the remove operation (attempt to delete a directory).\n");
         delete directory;
         delete fileHdr;
+        CloseDirFile(dirFile);
+        synchDisk->EndTransaction();
+        namespaceLock->ReleaseWrite();
         return FALSE; // directory File
     }
 
-    if (synchDisk->numVisitors[sector]) {
-        printf("unable to remove thr file,there are still %d visitors\n", synchDisk->numVisitors[sector]);
+    if (inodeTable->RefCount(sector)) {
+        printf("unable to remove thr file,there are still %d visitors\n", inodeTable->RefCount(sector));
+        delete directory;
+        delete fileHdr;
+        CloseDirFile(dirFile);
+        synchDisk->EndTransaction();
+        namespaceLock->ReleaseWrite();
         return FALSE;
     } else {
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
-
+        AcquireFreeMap();
         fileHdr->Deallocate(freeMap);  		// remove data blocks
         freeMap->Clear(sector);			// remove header block
+        ReleaseFreeMap();			// flush to disk
         directory->Remove(name);
 
-        freeMap->WriteBack(freeMapFile);		// flush to disk
-        directory->WriteBack(directoryFile);        // flush to disk
+        directory->WriteBack(dirFile);        // flush to disk
+        dentryCache->Enter(dirSector, name, -1);
+        dentryCache->Invalidate(sector);	// in case a path used it
         delete fileHdr;
         delete directory;
-        delete freeMap;
+        CloseDirFile(dirFile);
+        synchDisk->EndTransaction();
+        namespaceLock->ReleaseWrite();
         return TRUE;
     }
 } 
@@ -380,7 +472,9 @@ FileSystem::List()
 {
     Directory *directory = new Directory(NumDirEntries);
 
+    namespaceLock->AcquireRead();
     directory->FetchFrom(directoryFile);
+    namespaceLock->ReleaseRead();
     directory->List();
     delete directory;
 }
@@ -400,7 +494,6 @@ FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    BitMap *freeMap = new BitMap(NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
     printf("Bit map file header:\n");
@@ -411,15 +504,17 @@ FileSystem::Print()
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
-    freeMap->FetchFrom(freeMapFile);
+    freeMapLock->Acquire();
     freeMap->Print();
+    freeMapLock->Release();
 
+    namespaceLock->AcquireRead();
     directory->FetchFrom(directoryFile);
+    namespaceLock->ReleaseRead();
     directory->Print();
 
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 }
 
@@ -429,21 +524,27 @@ FileSystem::Print()
 // FindDir的类型本来应该为Directory*
 // 但是我在头文件中导入derectory.h时运行一直报错
 // 所以这里使用void*，后续使用Directory*进行强制转换
+//
+//	Takes shared access to the name space; LookupDir does the work
+//	for callers that already hold it.
 //----------------------------------------------------------------------
 void* FileSystem::FindDir(char* filePath) {
+    namespaceLock->AcquireRead();
+    void* dir = LookupDir(filePath);
+    namespaceLock->ReleaseRead();
+    return dir;
+}
+
+void* FileSystem::LookupDir(char* filePath) {
     Directory* returnDir = new Directory(NumDirEntries);
     //返回目标文件的扇区号
-    int sector = FindDirSector(filePath);
-    if(sector == DirectorySector) {
-        //目标文件在根目录下
-        //返回根目录结构
-        returnDir->FetchFrom(directoryFile);
-    } else if (sector != -1) {
+    int sector = LookupDirSector(filePath);
+    if (sector != -1) {
         //存在目标文件
-        OpenFile* dirFile = new OpenFile(sector);
+        OpenFile* dirFile = OpenDirFile(sector);
         //读入目标文件的目录结构
         returnDir->FetchFrom(dirFile);
-        delete dirFile;
+        CloseDirFile(dirFile);
     } else {
         DEBUG('D', "No such directory. (might be deleted)\n");
     }
@@ -455,34 +556,85 @@ void* FileSystem::FindDir(char* filePath) {
 // FileSystem::FindDirSector
 // 根据文件路径查看目标文件是否存在
 // 若存在返回扇区号，不存在返回-1
+//
+//	Lookups only read directories, so any number of threads can
+//	resolve paths at once; they wait only for Create/Remove.
 //----------------------------------------------------------------------
 int FileSystem::FindDirSector(char *filePath) {
+    namespaceLock->AcquireRead();
+    int sector = LookupDirSector(filePath);
+    namespaceLock->ReleaseRead();
+    return sector;
+}
+
+int FileSystem::LookupDirSector(char *filePath) {
     FilePath filepath = pathParser(filePath);
      //从根目录所在扇区开始
     int sector = DirectorySector;
      //不在根目录下
-    if(filepath.dirDepth != 0) {
-        OpenFile* dirFile;
-        Directory* dirTemp;
-        //根据目录深度查找目标文件扇区
-        for(int i = 0; i < filepath.dirDepth; i++) {
-            DEBUG('D', "Finding directory \"%s\" in sector \"%d\"\n", filepath.dirArray[i], sector);
-            dirFile = new OpenFile(sector);
-            dirTemp = new Directory(NumDirEntries);
-            //从目标文件中读入目录结构
-            dirTemp->FetchFrom(dirFile);
-            //在目录下查找目标文件扇区，不存在返回-1
-            sector = dirTemp->Find(filepath.dirArray[i]);
-            if (sector == -1)
-                break; 
-        }
-        delete dirFile;
-        delete dirTemp;
+    //根据目录深度查找目标文件扇区
+    for(int i = 0; i < filepath.dirDepth; i++) {
+        DEBUG('D', "Finding directory \"%s\" in sector \"%d\"\n", filepath.dirArray[i], sector);
+        //在目录下查找目标文件扇区，不存在返回-1
+        sector = LookupName(sector, filepath.dirArray[i]);
+        if (sector == -1)
+            break; 
     }
     //返回目标文件所在扇区
     return sector;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::LookupName
+// 	Find the sector of the file header for "name" in the directory
+//	whose header is at "dirSector"; -1 if it isn't there.
+//
+//	Results, including failed lookups, are kept in dentryCache, so a
+//	path walked before costs no disk reads.  Create and Remove/RemoveDir
+//	update the cache as they change a directory; all of this happens
+//	under namespaceLock, so the cache never disagrees with the disk.
+//----------------------------------------------------------------------
+
+int
+FileSystem::LookupName(int dirSector, char *name)
+{
+    int sector;
+
+    if (dentryCache->Find(dirSector, name, &sector))
+        return sector;
+
+    //只读入名字散列到的那几个目录项
+    OpenFile *dirFile = OpenDirFile(dirSector);
+    sector = Directory::Lookup(dirFile, name);
+    CloseDirFile(dirFile);
+    dentryCache->Enter(dirSector, name, sector);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirFile/CloseDirFile
+// 	Open and close the file holding a directory.  The root directory
+//	is kept open all the time; handing out that same OpenFile means
+//	that when the root grows, its in-core header stays up to date.
+//
+//	"sector" -- where the directory's file header is
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::OpenDirFile(int sector)
+{
+    if (sector == DirectorySector)
+        return directoryFile;
+    return new OpenFile(sector);
+}
+
+void
+FileSystem::CloseDirFile(OpenFile *file)
+{
+    if (file != directoryFile)
+        delete file;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::ListDir
 // ld 命令，列出目录下的所有文件
@@ -501,11 +653,20 @@ void FileSystem::ListDir(char *name) {
 //----------------------------------------------------------------------
 bool FileSystem::RemoveDir(char* name) {
     Directory *directory;
-    BitMap *freeMap;
     FileHeader *fileHdr;
     int sector;
 
-    directory = (Directory*)FindDir(name);
+    namespaceLock->AcquireWrite();
+    synchDisk->BeginTransaction();
+    int dirSector = LookupDirSector(name);
+    if (dirSector == -1) {
+       synchDisk->EndTransaction();
+       namespaceLock->ReleaseWrite();
+       return FALSE;             // no such directory
+    }
+    OpenFile *dirFile = OpenDirFile(dirSector);
+    directory = new Directory(NumDirEntries);
+    directory->FetchFrom(dirFile);
 
     FilePath filepath = pathParser(name);
     if (filepath.dirDepth > 0) {
@@ -515,23 +676,28 @@ bool FileSystem::RemoveDir(char* name) {
     sector = directory->Find(name);
     if (sector == -1) {
        delete directory;
+       CloseDirFile(dirFile);
+       synchDisk->EndTransaction();
+       namespaceLock->ReleaseWrite();
        return FALSE;             // file not found 
     }
     fileHdr = new FileHeader;
     fileHdr->FetchFrom(sector);
 
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
-
+    AcquireFreeMap();
     fileHdr->Deallocate(freeMap);       // remove data blocks
     freeMap->Clear(sector);         // remove header block
+    ReleaseFreeMap();               // flush to disk
     directory->Remove(name);
 
-    freeMap->WriteBack(freeMapFile);        // flush to disk
-    directory->WriteBack(directoryFile);        // flush to disk
+    directory->WriteBack(dirFile);        // flush to disk
+    dentryCache->Enter(dirSector, name, -1);
+    dentryCache->Invalidate(sector);      // its sector may be reused
     delete fileHdr;
     delete directory;
-    delete freeMap;
+    CloseDirFile(dirFile);
+    synchDisk->EndTransaction();
+    namespaceLock->ReleaseWrite();
     return TRUE;
 }
 
@@ -37,6 +37,11 @@
 
 #include "copyright.h"
 #include "openfile.h"
+
+class Lock;
+class RWLock;
+class BitMap;
+class DentryCache;
 #define FILESYS_STUB
 #ifdef FILESYS_STUB 		// Temporarily implement file system calls as 
 				// calls to UNIX, until the real file system
@@ -101,11 +106,31 @@ class FileSystem {
 	// 写入管道
     void WritePipe(char *data,int length);
 
+    BitMap *AcquireFreeMap();		// Lock the free map, to allocate
+    void ReleaseFreeMap();		// or free sectors; writing back
+					// what changed, and unlocking
+
   private:
    OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
+   BitMap* freeMap;			// ... and kept in memory
+   Lock* freeMapLock;			// Held while freeMap is in use
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+   RWLock* namespaceLock;		// Shared by path lookups, exclusive
+					// for Create/Remove/RemoveDir
+   DentryCache* dentryCache;		// Results of recent path lookups
+
+   void *LookupDir(char *filePath);	// FindDir/FindDirSector, for callers
+   int LookupDirSector(char *filePath);	// already holding namespaceLock
+   int LookupName(int dirSector, char *name);
+					// Look "name" up in one directory,
+					// through dentryCache
+
+   OpenFile *OpenDirFile(int sector);	// Open the directory file whose
+   void CloseDirFile(OpenFile *file);	// header is at "sector"; the root
+					// is always "directoryFile", so
+					// that it never goes stale
 };
 
 #endif // FILESYS
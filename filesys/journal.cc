@@ -0,0 +1,398 @@
+// journal.cc
+//	Routines to keep a write-ahead log of file system metadata.
+//
+//	The log is an append-only run of sectors: a header sector, then
+//	records one after another.  Each record has a sequence number
+//	one more than the one before it, and a checksum of its blocks,
+//	so at mount we can tell exactly how far the log was written --
+//	the first record that doesn't fit the sequence, or whose blocks
+//	don't match the checksum, ends it.
+//
+//	Appending always goes forward; when a transaction won't fit any
+//	more, we flush the buffer cache (so every block in the log is
+//	now on disk where it belongs) and start again at the front,
+//	recording in the header which sequence number comes next.
+//	Records left behind from before have smaller sequence numbers,
+//	and are never mistaken for new ones.
+//
+//	A block stays in the log until the next checkpoint, and mount
+//	writes it home again.  If the sector is reused meanwhile for
+//	something that isn't logged (say, file data), that old block
+//	would clobber it -- so such a write checkpoints first.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "system.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// LogRequestDone
+// 	Disk completion routine for log I/O; "arg" is the semaphore the
+//	journal waits on.
+//----------------------------------------------------------------------
+
+static void
+LogRequestDone(int arg)
+{
+    Semaphore *done = (Semaphore *) arg;
+
+    done->V();
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Set up a journal kept in "numSectors" sectors, starting at
+//	"firstSector".  Nothing is read; call Format or Mount next.
+//----------------------------------------------------------------------
+
+Journal::Journal(int firstSector, int numSectors)
+{
+    ASSERT(numSectors > 2 + MaxTransactionBlocks
+                + divRoundUp(MaxTransactionBlocks, BlocksPerRecord));
+    start = firstSector;
+    size = numSectors;
+    head = start + 1;
+    firstSeq = nextSeq = 1;
+
+    lock = new Lock("journal");
+    owner = NULL;
+    depth = 0;
+    committing = FALSE;
+    count = 0;
+    blocks = new char[MaxTransactionBlocks * SectorSize];
+    for (int i = 0; i < NumSectors; i++)
+        logged[i] = FALSE;
+    logDone = new Semaphore("journal I/O", 0);
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    delete lock;
+    delete [] blocks;
+    delete logDone;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Make the log empty.  Everything in it is cleared, so that nothing
+//	an earlier file system left there can look like a record.
+//----------------------------------------------------------------------
+
+void
+Journal::Format()
+{
+    char *zero = new char[size * SectorSize];
+
+    bzero(zero, size * SectorSize);
+    LogIO(start, zero, size, TRUE);
+    delete [] zero;
+    firstSeq = nextSeq = 1;
+    head = start + 1;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Mount
+// 	Read the log, and write every transaction found complete in it
+//	to where its blocks belong.  A transaction whose last record is
+//	missing or damaged never committed, so it is ignored.  The log is
+//	empty afterwards.
+//
+//	Must be called before anything else is read from the disk.
+//	Returns FALSE if there is no log on the disk at all.
+//----------------------------------------------------------------------
+
+bool
+Journal::Mount()
+{
+    char *buf = new char[SectorSize];
+    JournalHeader *hdr = (JournalHeader *) buf;
+    JournalRecord *rec = new JournalRecord;
+    char *pending = new char[MaxTransactionBlocks * SectorSize];
+    int pendingSectors[MaxTransactionBlocks];
+    int numPending = 0, numRedone = 0;
+    int seq, pos;
+
+    LogIO(start, buf, 1, FALSE);
+    if (hdr->magic != JournalMagic) {
+        delete [] buf;
+        delete rec;
+        delete [] pending;
+        return FALSE;
+    }
+
+    seq = hdr->firstSeq;
+    for (pos = start + 1; pos < start + size; pos += 1 + rec->count) {
+        LogIO(pos, (char *) rec, 1, FALSE);
+        if (rec->magic != RecordMagic || rec->seq != seq
+                || rec->count < 0 || rec->count > BlocksPerRecord
+                || numPending + rec->count > MaxTransactionBlocks
+                || pos + 1 + rec->count > start + size)
+            break;
+        LogIO(pos + 1, &pending[numPending * SectorSize], rec->count, FALSE);
+        if (Checksum(&pending[numPending * SectorSize], rec->count)
+                                                        != rec->checksum)
+            break;
+        for (int i = 0; i < rec->count; i++)
+            pendingSectors[numPending++] = rec->sectors[i];
+        seq++;
+        if (rec->last) {			// a whole transaction: redo it
+            for (int i = 0; i < numPending; i++)
+                synchDisk->WriteSector(pendingSectors[i],
+                                        &pending[i * SectorSize]);
+            numRedone += numPending;
+            numPending = 0;
+        }
+    }
+    DEBUG('f', "Journal: redid %d blocks, up to record %d\n", numRedone, seq);
+
+    // the redone blocks are safely home once the cache is flushed
+    synchDisk->Flush();
+    firstSeq = nextSeq = seq;
+    head = start + 1;
+    WriteHeader();
+
+    delete [] buf;
+    delete rec;
+    delete [] pending;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Open a transaction for the current thread, waiting for any other
+//	thread's transaction to end.  If the thread has one open already,
+//	this one just becomes part of it.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    if (owner == currentThread) {
+        depth++;
+        return;
+    }
+    lock->Acquire();
+    owner = currentThread;
+    depth = 1;
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Close the current thread's transaction.  Ending the outermost
+//	one commits everything written since it began.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    ASSERT(owner == currentThread && depth > 0);
+    if (--depth > 0)
+        return;
+    Commit();
+    owner = NULL;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Capture
+// 	Called by SynchDisk for every sector written.  Inside our own
+//	transaction, keep the new contents (replacing any kept earlier)
+//	and return TRUE: the write must not reach the disk before the
+//	log does.  Otherwise return FALSE, to let the write go ahead --
+//	after a checkpoint, if the log still holds an older copy of the
+//	sector.
+//
+//	If a transaction outgrows MaxTransactionBlocks, what it has so far
+//	is committed on its own; it then is no longer all-or-nothing.
+//----------------------------------------------------------------------
+
+bool
+Journal::Capture(int sector, char *data)
+{
+    int i;
+
+    if (owner == currentThread) {
+        if (committing)
+            return FALSE;
+        for (i = 0; i < count; i++)
+            if (sectors[i] == sector)
+                break;
+        if (i == count) {
+            if (count == MaxTransactionBlocks) {
+                DEBUG('f', "Journal: transaction too big, splitting it\n");
+                Commit();
+            }
+            i = count++;
+            sectors[i] = sector;
+        }
+        bcopy(data, &blocks[i * SectorSize], SectorSize);
+        return TRUE;
+    }
+    if (logged[sector]) {
+        lock->Acquire();
+        if (logged[sector])
+            Checkpoint();
+        lock->Release();
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Lookup
+// 	Called by SynchDisk for every sector read.  If the current thread
+//	wrote "sector" in its transaction, that is the copy it must see.
+//----------------------------------------------------------------------
+
+bool
+Journal::Lookup(int sector, char *data)
+{
+    if (owner != currentThread || committing)
+        return FALSE;
+    for (int i = 0; i < count; i++)
+        if (sectors[i] == sector) {
+            bcopy(&blocks[i * SectorSize], data, SectorSize);
+            return TRUE;
+        }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Append the transaction to the log, in as few records as it takes,
+//	with one write of consecutive sectors -- checkpointing first if
+//	there isn't room.  Once that is on disk the transaction is
+//	committed, and its blocks can go to their real places through
+//	the buffer cache, to be written whenever the cache gets to them.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    int numRecords, needed, pos, n, i;
+    JournalRecord *rec;
+    char *buf;
+
+    if (count == 0)
+        return;
+    numRecords = divRoundUp(count, BlocksPerRecord);
+    needed = numRecords + count;
+    if (head + needed > start + size)
+        Checkpoint();
+
+    buf = new char[needed * SectorSize];
+    bzero(buf, needed * SectorSize);
+    for (i = 0, pos = 0; i < count; i += n) {
+        n = min(count - i, BlocksPerRecord);
+        rec = (JournalRecord *) &buf[pos * SectorSize];
+        rec->magic = RecordMagic;
+        rec->seq = nextSeq++;
+        rec->count = n;
+        rec->last = (i + n == count);
+        rec->checksum = Checksum(&blocks[i * SectorSize], n);
+        for (int k = 0; k < n; k++)
+            rec->sectors[k] = sectors[i + k];
+        bcopy(&blocks[i * SectorSize], &buf[(pos + 1) * SectorSize],
+                                                        n * SectorSize);
+        pos += 1 + n;
+    }
+    LogIO(head, buf, needed, TRUE);
+    DEBUG('f', "Journal: committed %d blocks at sector %d\n", count, head);
+    head += needed;
+    delete [] buf;
+
+    committing = TRUE;
+    for (i = 0; i < count; i++) {
+        synchDisk->WriteSector(sectors[i], &blocks[i * SectorSize]);
+        logged[sectors[i]] = TRUE;
+    }
+    committing = FALSE;
+    count = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Empty the log.  Flushing the buffer cache puts every committed
+//	block on disk where it belongs; after that, nothing in the log
+//	is needed.  Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    DEBUG('f', "Journal: checkpoint at record %d\n", nextSeq);
+    synchDisk->Flush();
+    firstSeq = nextSeq;
+    head = start + 1;
+    WriteHeader();
+    for (int i = 0; i < NumSectors; i++)
+        logged[i] = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHeader
+// 	Write the log header, which says where the live records begin.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteHeader()
+{
+    char *buf = new char[SectorSize];
+    JournalHeader *hdr = (JournalHeader *) buf;
+
+    bzero(buf, SectorSize);
+    hdr->magic = JournalMagic;
+    hdr->firstSeq = firstSeq;
+    LogIO(start, buf, 1, TRUE);
+    delete [] buf;
+}
+
+//----------------------------------------------------------------------
+// Journal::LogIO
+// 	Read or write "numSectors" consecutive log sectors, and wait for
+//	them.  The log never goes through the buffer cache: a write has
+//	to be on disk when this returns.  The requests are all queued at
+//	once, so the disk does them in a single sweep.
+//----------------------------------------------------------------------
+
+void
+Journal::LogIO(int sector, char *data, int numSectors, bool writing)
+{
+    int i;
+
+    for (i = 0; i < numSectors; i++)
+        if (writing)
+            synchDisk->WriteRequest(sector + i, &data[i * SectorSize],
+                                        LogRequestDone, (int) logDone);
+        else
+            synchDisk->ReadRequest(sector + i, &data[i * SectorSize],
+                                        LogRequestDone, (int) logDone);
+    for (i = 0; i < numSectors; i++)
+        logDone->P();
+}
+
+//----------------------------------------------------------------------
+// Journal::Checksum
+// 	Compute a checksum over "numSectors" sectors of data, so that a
+//	record whose blocks were not all written can be recognized.
+//----------------------------------------------------------------------
+
+unsigned int
+Journal::Checksum(char *data, int numSectors)
+{
+    unsigned int *words = (unsigned int *) data;
+    unsigned int sum = 0;
+
+    for (int i = 0; i < numSectors * SectorSize / (int) sizeof(unsigned int); i++)
+        sum = ((sum << 5) | (sum >> 27)) ^ words[i];
+    return sum;
+}
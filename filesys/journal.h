@@ -0,0 +1,120 @@
+// journal.h
+//	Data structures for a write-ahead log (journal) of file system
+//	metadata updates.
+//
+//	A run of sectors at a fixed place on the disk holds the log.  A
+//	transaction groups the metadata writes of one file system
+//	operation -- file headers, index blocks, directory and bitmap
+//	sectors -- so that after a crash either all of them or none of
+//	them are found on disk.
+//
+//	While a transaction is open, SynchDisk hands the sectors it
+//	writes to the journal, which keeps them.  When the transaction
+//	ends, they are appended to the log as one sequential write, and
+//	only then written to their real place on disk, through the
+//	buffer cache like any other write.  Those copies reach the disk
+//	whenever the cache gets to it; the log is only emptied (the
+//	"checkpoint") when it fills up, after flushing the cache.  At
+//	mount, transactions found complete in the log are written again.
+//
+//	Since a thread inside a transaction takes other file system locks
+//	(the inode table's, the free map's), a transaction has to be begun
+//	before any of those are taken, never while holding one.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+
+class Lock;
+class Semaphore;
+class Thread;
+
+#define JournalMagic	0x4a524e4c	// marks the log header, "JRNL"
+#define RecordMagic	0x52454344	// marks a record, "RECD"
+
+// A record is one descriptor sector, listing where its blocks belong,
+// followed by the blocks themselves.  A transaction too big for one
+// record is split over several; only the last has "last" set.
+#define BlocksPerRecord	((SectorSize - 5 * sizeof(int)) / sizeof(int))
+#define MaxTransactionBlocks	(2 * BlocksPerRecord)
+
+class JournalHeader {			// first sector of the log
+  public:
+    int magic;				// JournalMagic
+    int firstSeq;			// sequence number of the oldest
+					// record not yet checkpointed
+};
+
+class JournalRecord {			// descriptor sector of a record
+  public:
+    int magic;				// RecordMagic
+    int seq;				// one more than the record before
+    int count;				// blocks that follow
+    int last;				// ends a transaction?
+    unsigned int checksum;		// over the blocks that follow
+    int sectors[BlocksPerRecord];	// where each block belongs
+};
+
+// The following class defines the journal.  Begin/End bracket a
+// transaction; they nest, and only the outermost End commits.  One
+// thread at a time may have a transaction open.
+
+class Journal {
+  public:
+    Journal(int firstSector, int numSectors);
+					// The log is "numSectors" sectors
+					// starting at "firstSector"
+    ~Journal();
+
+    void Format();			// Start an empty log
+    bool Mount();			// Redo the complete transactions
+					// in the log; FALSE if the disk
+					// has no log
+
+    void Begin();			// Open (or nest) a transaction
+    void End();				// Close it, committing at the top
+
+    bool Capture(int sector, char *data);
+					// Keep a write made inside our
+					// transaction; TRUE if kept
+    bool Lookup(int sector, char *data);
+					// Read back a kept write; TRUE
+					// if there was one
+
+  private:
+    int start;				// sector holding the JournalHeader
+    int size;				// sectors in the log, with it
+    int head;				// where the next record goes
+    int firstSeq;			// as in the JournalHeader
+    int nextSeq;			// sequence number of the next record
+
+    Lock *lock;				// held for a whole transaction
+    Thread *owner;			// thread with a transaction open
+    int depth;				// how deeply Begin is nested
+    bool committing;			// writing our blocks home?
+
+    int count;				// blocks in the transaction
+    int sectors[MaxTransactionBlocks];	// where each belongs
+    char *blocks;			// their contents
+
+    bool logged[NumSectors];		// in the log since the last
+					// checkpoint?
+    Semaphore *logDone;			// signalled as log I/O completes
+
+    void Commit();			// append the transaction, then
+					// write its blocks home
+    void Checkpoint();			// flush the cache, empty the log
+    void WriteHeader();
+    void LogIO(int sector, char *data, int numSectors, bool writing);
+					// raw, bypassing the cache
+    static unsigned int Checksum(char *data, int numSectors);
+};
+
+#endif // JOURNAL_H
@@ -5,7 +5,8 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  There is one in-core copy of it,
+//	kept in the InodeTable, however many times the file is open.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -15,27 +16,121 @@
 #include "filehdr.h"
 #include "openfile.h"
 #include "system.h"
+#include "synch.h"
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
 
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize the table of in-core file headers; nothing is open.
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable()
+{
+    lock = new Lock("inode table");
+    for (int i = 0; i < NumSectors; i++) {
+        inode[i] = NULL;
+        refCount[i] = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table, and the headers still in it.
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    for (int i = 0; i < NumSectors; i++)
+        delete inode[i];
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Get
+// 	Return the in-core header for the file whose header is at
+//	"sector", adding a reference to it.  Only the first reference
+//	reads the header from disk.
+//
+//	The lock is held while reading, so that a second thread opening
+//	the same file waits for the header instead of reading it again.
+//----------------------------------------------------------------------
+
+FileHeader *
+InodeTable::Get(int sector)
+{
+    ASSERT(sector >= 0 && sector < NumSectors);
+    lock->Acquire();
+    if (refCount[sector] == 0) {
+        ASSERT(inode[sector] == NULL);
+        inode[sector] = new FileHeader;
+        inode[sector]->FetchFrom(sector);
+        // Necessary, because we need to update
+        // FileHeader(i-node) later on.
+        inode[sector]->setHeaderSector(sector);
+    }
+    refCount[sector]++;
+    FileHeader *hdr = inode[sector];
+    lock->Release();
+    return hdr;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Put
+// 	Drop a reference to the header at "sector".  When the last one
+//	goes, write the header back if it was changed, and free it.
+//----------------------------------------------------------------------
+
+void
+InodeTable::Put(int sector)
+{
+    synchDisk->BeginTransaction();	// before the lock: see journal.h
+    lock->Acquire();
+    ASSERT(refCount[sector] > 0);
+    if (--refCount[sector] == 0) {
+        if (inode[sector]->IsDirty())
+            inode[sector]->WriteBack(sector);
+        delete inode[sector];
+        inode[sector] = NULL;
+    }
+    lock->Release();
+    synchDisk->EndTransaction();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Flush
+// 	Write back the changed headers of files that are still open,
+//	e.g. the free map and root directory when Nachos halts.
+//----------------------------------------------------------------------
+
+void
+InodeTable::Flush()
+{
+    synchDisk->BeginTransaction();
+    lock->Acquire();
+    for (int i = 0; i < NumSectors; i++)
+        if (inode[i] != NULL && inode[i]->IsDirty())
+            inode[i]->WriteBack(i);
+    lock->Release();
+    synchDisk->EndTransaction();
+}
+
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open (unless it is there already).
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 // openfile.cc
 OpenFile::OpenFile(int sector)
 { 
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
-    // Necessary, because we need to update
-    // FileHeader(i-node) later on.
-    hdr->setHeaderSector(sector);
-    synchDisk->numVisitors[hdr->getHeaderSector()] ++;
+    hdr = inodeTable->Get(sector);
     seekPosition = 0;
+    nextSequential = 0;
+    readAheadWindow = 0;
+    readAheadNext = 0;
 }
 
 //----------------------------------------------------------------------
@@ -45,10 +140,21 @@ OpenFile::OpenFile(int sector)
 
 OpenFile::~OpenFile()
 {
-    // Update header info
-    hdr->WriteBack(hdr->getHeaderSector());
-    synchDisk->numVisitors[hdr->getHeaderSector()] --;
-    delete hdr;
+    // the last close writes the header back, if it changed
+    inodeTable->Put(hdr->getHeaderSector());
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Reopen
+// 	Open the same file again, e.g. for a forked address space to page
+//	from.  The new OpenFile shares the in-core header, but has its
+//	own seek position.
+//----------------------------------------------------------------------
+
+OpenFile *
+OpenFile::Reopen()
+{
+    return new OpenFile(hdr->getHeaderSector());
 }
 
 //----------------------------------------------------------------------
@@ -107,6 +213,10 @@ OpenFile::Write(char *into, int numBytes)
 //	For ReadAt:
 //	   We read in all of the full or partial sectors that are part of the
 //	   request, but we only copy the part we are interested in.
+//	   If the request starts where the last one ended, the file is
+//	   being read sequentially: ask the disk to read ahead the sectors
+//	   that come next, doubling how far ahead we go (up to
+//	   MaxReadAhead) each time the pattern continues.
 //	For WriteAt:
 //	   We must first read in any sectors that will be partially written,
 //	   so that we don't overwrite the unmodified portion.  We then copy
@@ -120,7 +230,7 @@ OpenFile::Write(char *into, int numBytes)
 //			read/written
 //----------------------------------------------------------------------
 
-#define FreeMapSector	0
+#define InitialReadAhead	2	// sectors read ahead at first
 
 int
 OpenFile::ReadAt(char *into, int numBytes, int position)
@@ -150,8 +260,25 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete [] buf;
 
+    // sequential so far?  then read ahead what comes next
+    if (position == nextSequential) {
+        if (readAheadWindow == 0)
+            readAheadWindow = InitialReadAhead;
+        else
+            readAheadWindow = min(2 * readAheadWindow, MaxReadAhead);
+        i = max(readAheadNext, lastSector + 1);
+        readAheadNext = min(lastSector + 1 + readAheadWindow,
+                                divRoundUp(fileLength, SectorSize));
+        for (; i < readAheadNext; i++)
+            synchDisk->ReadAhead(hdr->ByteToSector(i * SectorSize));
+    } else {
+        readAheadWindow = 0;
+        readAheadNext = 0;
+    }
+    nextSequential = position + numBytes;
+
     // Lab5: file header info update
-    hdr->setVisitTime(getCurrentTime());
+    hdr->FileAccessed();
     return numBytes;
 }
 
@@ -166,13 +293,18 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     // Lab5: dynamic allocate file size
     // 如果超过了文件长度
     if (position + numBytes > fileLength) {
-        BitMap *freeMap = new BitMap(NumSectors);
-        OpenFile* freeMapFile = new OpenFile(FreeMapSector);
-        freeMap->FetchFrom(freeMapFile);
-        hdr->ExpandFileSize(freeMap, position + numBytes - fileLength);
-        hdr->WriteBack(hdr->getHeaderSector());
-        freeMap->WriteBack(freeMapFile);
-        delete freeMapFile;
+        // header, index blocks and free map change together
+        synchDisk->BeginTransaction();
+        BitMap *freeMap = fileSystem->AcquireFreeMap();
+        // both of the above can block: another writer may have grown
+        // the file meanwhile, so expand only by what is still missing
+        fileLength = hdr->FileLength();
+        if (position + numBytes > fileLength) {
+            hdr->ExpandFileSize(freeMap, position + numBytes - fileLength);
+            hdr->WriteBack(hdr->getHeaderSector());
+        }
+        fileSystem->ReleaseFreeMap();
+        synchDisk->EndTransaction();
         fileLength = hdr->FileLength();
     }
 
@@ -193,11 +325,13 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
 
 // read in first and last sector, if they are to be partially modified
+// (straight from the disk, so as not to disturb read-ahead)
     if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
+        synchDisk->ReadSector(hdr->ByteToSector(firstSector * SectorSize),
+				buf);
     if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
+        synchDisk->ReadSector(hdr->ByteToSector(lastSector * SectorSize),
+				&buf[(lastSector - firstSector) * SectorSize]);
 
 // copy in the bytes we want to change 
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
@@ -207,8 +341,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
         synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
 					&buf[(i - firstSector) * SectorSize]);
     delete [] buf;
-    hdr->setVisitTime(getCurrentTime());
-    hdr->setModifyTime(getCurrentTime());
+    hdr->FileModified();
     return numBytes;
 }
 
@@ -30,6 +30,8 @@ class OpenFile {
   public:
     OpenFile(int f) { file = f; currentOffset = 0; }	// open the file
     ~OpenFile() { Close(file); }			// close the file
+    OpenFile *Reopen() { return new OpenFile(Dup(file)); }
+							// open it again
 
     int ReadAt(char *into, int numBytes, int position) { 
     		Lseek(file, position, 0); 
@@ -59,13 +61,45 @@ class OpenFile {
 };
 
 #else // FILESYS
+#include "disk.h"
+
 class FileHeader;
+class Lock;
+
+// The following class is the table of in-core file headers ("inodes").
+// All the OpenFiles on one file share a single FileHeader, found by the
+// sector the header lives in on disk, so they agree on the file's
+// length, and opening a file that is already open reads nothing.
+// The header is written back only when the last OpenFile on it is
+// closed, and only if it was changed.
+
+class InodeTable {
+  public:
+    InodeTable();			// Initialize an empty table
+    ~InodeTable();
+
+    FileHeader *Get(int sector);	// Take a reference to the header
+					// at "sector", reading it in if
+					// it isn't in core yet
+    void Put(int sector);		// Drop a reference; the last one
+					// writes the header back if dirty
+    int RefCount(int sector) { return refCount[sector]; }
+					// How many OpenFiles use "sector"
+    void Flush();			// Write back every dirty header
+					// that is still in use
+
+  private:
+    Lock *lock;				// Get/Put may wait for the disk
+    FileHeader *inode[NumSectors];	// In-core header, NULL if unused
+    int refCount[NumSectors];		// OpenFiles sharing it
+};
 
 class OpenFile {
   public:
     OpenFile(int sector);		// Open a file whose header is located
 					// at "sector" on the disk
     ~OpenFile();			// Close the file
+    OpenFile *Reopen();			// Open the same file again
 
     void Seek(int position); 		// Set the position from which to 
 					// start reading/writing -- UNIX lseek
@@ -87,8 +121,15 @@ class OpenFile {
 					// end of file, tell, lseek back 
     
   private:
-    FileHeader *hdr;			// Header for this file 
+    FileHeader *hdr;			// Header for this file, shared
+					// through the InodeTable
     int seekPosition;			// Current position within the file
+
+    int nextSequential;			// Where a sequential ReadAt would
+					// start next
+    int readAheadWindow;		// Sectors to keep read ahead, grows
+					// while reads stay sequential
+    int readAheadNext;			// First sector not yet read ahead
 };
 
 #endif // FILESYS
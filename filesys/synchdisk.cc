@@ -5,10 +5,16 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Because the physical disk can only handle one operation at a
+//	time, requests wait in a queue; the interrupt handler starts the
+//	next one in C-LOOK order as each completes.  A thread waiting for
+//	its own request sleeps on a semaphore that the request's
+//	completion routine signals.
+//
+//	In front of the disk sits a write-back buffer cache, replaced
+//	with the CLOCK algorithm and protected by "lock".  The lock is not
+//	held while the disk works; instead, a buffer with I/O in progress
+//	is marked busy, and anyone who wants it waits until it is ready.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,6 +22,7 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -31,6 +38,28 @@ DiskRequestDone (int arg)
     disk->RequestDone();
 }
 
+//----------------------------------------------------------------------
+// WakeUp, BufferReady
+// 	Completion routines for disk requests.  WakeUp signals the thread
+//	waiting for a request; BufferReady makes a cache buffer usable
+//	again, letting through anyone waiting for it.
+//----------------------------------------------------------------------
+
+static void
+WakeUp(int arg)
+{
+    ((Semaphore *)arg)->V();
+}
+
+static void
+BufferReady(int arg)
+{
+    SectorBuffer *buf = (SectorBuffer *)arg;
+
+    buf->busy = FALSE;
+    buf->ready->V();
+}
+
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
@@ -38,42 +67,58 @@ DiskRequestDone (int arg)
 //
 //	"name" -- UNIX file name to be used as storage for the disk data
 //	   (usually, "DISK")
+//	"numBuffers" -- number of sectors in the buffer cache
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk(char* name)
+SynchDisk::SynchDisk(char* name, int numBuffers)
 {
-    semaphore = new Semaphore("synch disk", 0);
     lock = new Lock("synch disk lock");
+    journal = NULL;
     disk = new Disk(name, DiskRequestDone, (int) this);
+    queue = active = NULL;
+    numQueued = 0;
 
-    readerLock = new Lock("ReaderLock");
     for (int i = 0; i < NumSectors; i ++) {
-        numReaders[i] = 0;
-        mutex[i] = new Semaphore("Lock", 1);
+        sectorLock[i] = new RWLock("sector lock");
+        slotOf[i] = -1;
     }
+
+    ASSERT(numBuffers >= 0 && numBuffers <= NumSectors);
+    cacheSize = numBuffers;
+    cache = new SectorBuffer[cacheSize];
+    for (int i = 0; i < cacheSize; i++) {
+        cache[i].sector = -1;
+        cache[i].dirty = cache[i].referenced = cache[i].busy = FALSE;
+        cache[i].ready = new Semaphore("sector buffer", 1);
+    }
+    hand = 0;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::~SynchDisk
 // 	De-allocate data structures needed for the synchronous disk
-//	abstraction.
+//	abstraction.  Dirty cached sectors have been flushed already when
+//	Nachos halts; if it is killed instead, they are lost, as in a
+//	crash.
 //----------------------------------------------------------------------
 
 SynchDisk::~SynchDisk()
 {
+    for (int i = 0; i < cacheSize; i++)
+        delete cache[i].ready;
+    delete [] cache;
     delete disk;
     delete lock;
-    delete semaphore;
-    delete readerLock;
     for (int i = 0; i < NumSectors; i ++) {
-        delete mutex[i];
+        delete sectorLock[i];
     }
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::ReadSector
 // 	Read the contents of a disk sector into a buffer.  Return only
-//	after the data has been read.
+//	after the data has been read.  If the sector is cached, no disk
+//	I/O is needed; otherwise it is read into the cache first.
 //
 //	"sectorNumber" -- the disk sector to read
 //	"data" -- the buffer to hold the contents of the disk sector
@@ -82,16 +127,25 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
+    SectorBuffer *buf;
+
+    if (journal != NULL && journal->Lookup(sectorNumber, data))
+	return;				// written in our transaction
+    if (cacheSize == 0) {
+	DiskIO(sectorNumber, data, FALSE);
+	return;
+    }
+    lock->Acquire();
+    buf = GetBuffer(sectorNumber, FALSE);
+    bcopy(buf->data, data, SectorSize);
     lock->Release();
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
-// 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+// 	Write the contents of a buffer into a disk sector.  With the
+//	cache on, this only updates the cached copy and marks it dirty;
+//	since the whole sector is overwritten, a miss needs no read.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -100,55 +154,404 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
+    SectorBuffer *buf;
+
+    if (journal != NULL && journal->Capture(sectorNumber, data))
+	return;				// goes to the log first
+    if (cacheSize == 0) {
+	DiskIO(sectorNumber, data, TRUE);
+	return;
+    }
+    lock->Acquire();
+    buf = GetBuffer(sectorNumber, TRUE);
+    bcopy(data, buf->data, SectorSize);
+    buf->dirty = TRUE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Write every dirty sector in the cache back to disk, and wait for
+//	the writes to finish.  The sectors stay cached, now clean.
+//	Called at shutdown, from Sync.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    int i;
+
+    lock->Acquire();
+    for (i = 0; i < cacheSize; i++)
+	if (cache[i].dirty && !cache[i].busy)
+	    StartIO(&cache[i], TRUE);	// all go into the queue at once
+    for (i = 0; i < cacheSize; i++)
+	while (cache[i].busy || cache[i].dirty) {
+	    if (!cache[i].busy)
+		StartIO(&cache[i], TRUE);	// dirtied meanwhile
+	    WaitReady(&cache[i]);
+	}
     lock->Release();
 }
 
+//----------------------------------------------------------------------
+// SynchDisk::BeginTransaction/EndTransaction
+// 	Bracket a group of metadata writes that must reach the disk all
+//	together or not at all.  Until the outermost EndTransaction, the
+//	writes are held by the journal; see journal.h.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::BeginTransaction()
+{
+    if (journal != NULL)
+	journal->Begin();
+}
+
+void
+SynchDisk::EndTransaction()
+{
+    if (journal != NULL)
+	journal->End();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadAhead
+// 	Start reading "sectorNumber" into the cache, and return right
+//	away.  Nothing happens if the sector is already cached, if the
+//	disk has plenty queued already, or if Recycle can't hand us a
+//	buffer on the first try -- read-ahead is only a hint.
+//
+//	"sectorNumber" -- the disk sector we expect to be read soon
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadAhead(int sectorNumber)
+{
+    SectorBuffer *buf;
+
+    if (cacheSize == 0)
+	return;
+    lock->Acquire();
+    if (slotOf[sectorNumber] == -1 && numQueued < MaxReadAhead) {
+	buf = Recycle(sectorNumber);
+	if (buf != NULL) {
+	    DEBUG('d', "Reading ahead sector %d\n", sectorNumber);
+	    buf->referenced = FALSE;	// not used until somebody reads it
+	    StartIO(buf, FALSE);
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadRequest/WriteRequest
+// 	Queue a request for the disk and return immediately, without
+//	going through the cache.  "callWhenDone(callArg)" is invoked from
+//	the interrupt handler once the request has completed; until then
+//	"data" must stay put.
+//
+//	"sectorNumber" -- the disk sector to read/write
+//	"data" -- the buffer to read into/write from
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadRequest(int sectorNumber, char* data,
+			VoidFunctionPtr callWhenDone, int callArg)
+{
+    DiskRequest *request = new DiskRequest;
+
+    request->sector = sectorNumber;
+    request->data = data;
+    request->writing = FALSE;
+    request->callWhenDone = callWhenDone;
+    request->callArg = callArg;
+    Submit(request);
+}
+
+void
+SynchDisk::WriteRequest(int sectorNumber, char* data,
+			VoidFunctionPtr callWhenDone, int callArg)
+{
+    DiskRequest *request = new DiskRequest;
+
+    request->sector = sectorNumber;
+    request->data = data;
+    request->writing = TRUE;
+    request->callWhenDone = callWhenDone;
+    request->callArg = callArg;
+    Submit(request);
+}
+
 //----------------------------------------------------------------------
 // SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Keep the disk busy by starting the next
+//	request, then notify whoever issued the one that just finished.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::RequestDone()
 { 
-    semaphore->V();
+    DiskRequest *done = active;
+
+    ASSERT(done != NULL);
+    active = NULL;
+    StartNext();
+    (*done->callWhenDone)(done->callArg);
+    delete done;
 }
 
-// 读者读时申请锁
-void 
-SynchDisk::PlusReader(int sector) {
-    readerLock->Acquire();
-    numReaders[sector] ++;
-    if (numReaders[sector] == 1) {
-        mutex[sector]->P();
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Add a request to the queue, and start it right away if the disk
+//	is idle.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Submit(DiskRequest *request)
+{
+    DiskRequest **ptr;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT((request->sector >= 0) && (request->sector < NumSectors));
+    for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next)
+	;
+    request->next = NULL;
+    *ptr = request;			// FIFO among equally good requests
+    numQueued++;
+    if (active == NULL)
+	StartNext();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartNext
+// 	Send the disk the queued request that comes next in C-LOOK order.
+//	A request's place is how many tracks the head has to travel
+//	upwards to reach it (wrapping around past the last track, so the
+//	ones behind the head come after all the ones ahead of it), and
+//	within a track, how many sectors have to rotate by first.
+//
+//	Called with interrupts off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartNext()
+{
+    DiskRequest **ptr, **best = NULL;
+    int headTrack = disk->HeadSector() / SectorsPerTrack;
+    int tracks, seek, rotation, delay, place, bestPlace = 0;
+
+    if (queue == NULL)
+	return;
+    for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next) {
+	tracks = (*ptr)->sector / SectorsPerTrack - headTrack;
+	if (tracks < 0)
+	    tracks += NumTracks;
+	seek = disk->TimeToSeek((*ptr)->sector, &rotation);
+	delay = disk->ModuloDiff((*ptr)->sector,
+			(stats->totalTicks + seek + rotation) / RotationTime);
+	place = tracks * SectorsPerTrack + delay;
+	if (best == NULL || place < bestPlace) {
+	    best = ptr;
+	    bestPlace = place;
+	}
     }
-    // printf("reader cnt: %d\n", numReaders[sector]);
-    readerLock->Release();
+    active = *best;
+    *best = active->next;
+    numQueued--;
+    if (active->writing)
+	disk->WriteRequest(active->sector, active->data);
+    else
+	disk->ReadRequest(active->sector, active->data);
 }
 
-// 读者结束读时释放锁
+//----------------------------------------------------------------------
+// SynchDisk::DiskIO
+// 	Queue a request and wait for it to complete.
+//----------------------------------------------------------------------
+
 void
-SynchDisk::MinusReader(int sector) {
-    readerLock->Acquire();
-    numReaders[sector]--;
-    if (numReaders[sector] == 0) {
-        mutex[sector]->V();
+SynchDisk::DiskIO(int sector, char* data, bool writing)
+{
+    Semaphore *done = new Semaphore("disk request", 0);
+
+    if (writing)
+	WriteRequest(sector, data, WakeUp, (int) done);
+    else
+	ReadRequest(sector, data, WakeUp, (int) done);
+    done->P();				// wait for interrupt
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::GetBuffer
+// 	Return the buffer caching "sector", ready to use.  On a miss, a
+//	buffer is recycled and, unless the caller is about to "overwrite"
+//	all of it, the sector is read in.  Whenever we have to wait, the
+//	lock is released, so start over afterwards: the cache may have
+//	changed.  Counts one cache hit or miss.
+//
+//	Caller must hold "lock".
+//----------------------------------------------------------------------
+
+SectorBuffer *
+SynchDisk::GetBuffer(int sector, bool overwrite)
+{
+    SectorBuffer *buf;
+    bool counted = FALSE;
+
+    for (;;) {
+	if (slotOf[sector] != -1) {
+	    buf = &cache[slotOf[sector]];
+	    if (!counted)
+		stats->numCacheHits++;
+	    counted = TRUE;
+	    buf->referenced = TRUE;
+	    if (!buf->busy)
+		return buf;
+	    WaitReady(buf);		// being read ahead or written back
+	    continue;
+	}
+	if (!counted)
+	    stats->numCacheMisses++;
+	counted = TRUE;
+	buf = Recycle(sector);
+	if (buf == NULL)
+	    continue;			// Recycle had to wait
+	if (overwrite)
+	    return buf;
+	StartIO(buf, FALSE);
+	WaitReady(buf);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Recycle
+// 	Pick a buffer for "sector", which isn't cached, using the CLOCK
+//	algorithm: sweep the hand past buffers that were referenced since
+//	its last pass (clearing the bit), and take the first that wasn't.
+//	Busy buffers are skipped.
+//
+//	A dirty victim has to be written back first: start the write,
+//	wait for it and return NULL, so the caller looks again.  Also
+//	return NULL after waiting if every buffer is busy.
+//
+//	Caller must hold "lock".
+//----------------------------------------------------------------------
+
+SectorBuffer *
+SynchDisk::Recycle(int sector)
+{
+    SectorBuffer *buf = NULL;
+
+    for (int i = 0; i < 2 * cacheSize; i++) {
+	buf = &cache[hand];
+	hand = (hand + 1) % cacheSize;
+	if (buf->busy)
+	    continue;			// I/O in progress
+	if (buf->sector == -1 || !buf->referenced)
+	    break;
+	buf->referenced = FALSE;
+	buf = NULL;
+    }
+    if (buf == NULL || buf->busy) {
+	lock->Release();		// all busy, let some I/O finish
+	currentThread->Yield();
+	lock->Acquire();
+	return NULL;
+    }
+    if (buf->dirty) {
+	DEBUG('d', "Writing back sector %d from the cache\n", buf->sector);
+	StartIO(buf, TRUE);
+	WaitReady(buf);
+	return NULL;
     }
-    readerLock->Release();
+    if (buf->sector != -1)
+	slotOf[buf->sector] = -1;
+    buf->sector = sector;
+    buf->referenced = TRUE;
+    slotOf[sector] = buf - cache;
+    return buf;
 }
 
-//写者开始写时申请锁
+//----------------------------------------------------------------------
+// SynchDisk::StartIO
+// 	Queue a read of a buffer's sector into it, or a write of it back
+//	to disk, and mark it busy until BufferReady runs.
+//
+//	Caller must hold "lock".
+//----------------------------------------------------------------------
+
 void
-SynchDisk::BeginWrite(int sector) {
-    mutex[sector]->P();
+SynchDisk::StartIO(SectorBuffer *buf, bool writing)
+{
+    ASSERT(!buf->busy);
+    buf->busy = TRUE;
+    buf->ready->P();			// at most waits for a thread
+					// passing through WaitReady
+    if (writing) {
+	buf->dirty = FALSE;
+	WriteRequest(buf->sector, buf->data, BufferReady, (int) buf);
+    } else
+	ReadRequest(buf->sector, buf->data, BufferReady, (int) buf);
 }
 
-//写者结束写时释放锁
+//----------------------------------------------------------------------
+// SynchDisk::WaitReady
+// 	Wait until "buf" isn't busy.  Passing straight through "ready"
+//	leaves it open for the next waiter.  The lock is given up while
+//	we wait, so the caller must look at the cache afresh afterwards.
+//
+//	Caller must hold "lock".
+//----------------------------------------------------------------------
+
 void
-SynchDisk::EndWrite(int sector) {
-    mutex[sector]->V();
+SynchDisk::WaitReady(SectorBuffer *buf)
+{
+    lock->Release();
+    buf->ready->P();
+    buf->ready->V();
+    lock->Acquire();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::PlusReader/MinusReader
+// 	Take and give up shared access to a sector.  Any number of threads
+//	may read the sector (say, the same file header) at once; only a
+//	writer excludes them.  This is independent of "lock", which merely
+//	keeps the disk itself to one request at a time.
+//
+//	"sector" -- the sector being read
+//----------------------------------------------------------------------
+
+void 
+SynchDisk::PlusReader(int sector)
+{
+    sectorLock[sector]->AcquireRead();
+}
+
+void
+SynchDisk::MinusReader(int sector)
+{
+    sectorLock[sector]->ReleaseRead();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::BeginWrite/EndWrite
+// 	Take and give up exclusive access to a sector.
+//
+//	"sector" -- the sector being written
+//----------------------------------------------------------------------
+
+void
+SynchDisk::BeginWrite(int sector)
+{
+    sectorLock[sector]->AcquireWrite();
+}
+
+void
+SynchDisk::EndWrite(int sector)
+{
+    sectorLock[sector]->ReleaseWrite();
 }
@@ -13,6 +13,33 @@
 
 #include "disk.h"
 #include "synch.h"
+#include "journal.h"
+
+#define DefaultCacheSize	64	// sectors kept in the buffer cache
+#define MaxReadAhead		8	// requests queued before we stop
+					// reading ahead
+
+// A request waiting for the disk.  "callWhenDone(callArg)" is invoked
+// from the disk interrupt handler once the request has completed.
+struct DiskRequest {
+    int sector;				// sector to read or write
+    char *data;				// where to read into/write from
+    bool writing;			// is this a write?
+    VoidFunctionPtr callWhenDone;	// completion notification
+    int callArg;
+    DiskRequest *next;			// next request in the queue
+};
+
+// One sector's worth of the buffer cache.
+struct SectorBuffer {
+    int sector;				// which sector is cached, -1 if none
+    bool dirty;				// modified since it was read/written
+    bool referenced;			// used since the clock hand last passed
+    bool busy;				// being read or written back, "data"
+					// can't be touched until it's done
+    Semaphore *ready;			// 1 while not busy: P+V to wait
+    char data[SectorSize];
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -24,10 +51,26 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// Underneath, requests from all threads go into one queue, and
+// whenever the disk finishes a request the next one is picked in
+// C-LOOK order: the head sweeps towards higher tracks serving requests
+// as it passes them, then jumps back to the lowest track requested.
+// ReadRequest/WriteRequest expose the queue directly to callers that
+// don't want to wait.
+//
+// Recently used sectors are kept in a write-back buffer cache, so a
+// request that hits in the cache returns without touching the disk.
+// Writes only dirty the cached copy; it goes to disk when its buffer
+// is recycled, or on Flush.  ReadAhead starts reading a sector into
+// the cache without waiting for it.
 class SynchDisk {
   public:
-    SynchDisk(char* name);    		// Initialize a synchronous disk,
+    SynchDisk(char* name, int numBuffers = DefaultCacheSize);
+    					// Initialize a synchronous disk,
 					                        // by initializing the raw Disk.
+					// "numBuffers" sectors are cached,
+					// 0 means no caching at all.
     ~SynchDisk();			            // De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
@@ -37,33 +80,58 @@ class SynchDisk {
     					                    // Disk::ReadRequest/WriteRequest and
 					                        // then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+    void Flush();			// Write all dirty cached sectors back
+    void ReadAhead(int sectorNumber);	// Start reading a sector into the
+					// cache, without waiting for it
+
+    void ReadRequest(int sectorNumber, char* data,
+		VoidFunctionPtr callWhenDone, int callArg);
+    void WriteRequest(int sectorNumber, char* data,
+		VoidFunctionPtr callWhenDone, int callArg);
+					// Queue a request, bypassing the
+					// cache, and return immediately;
+					// callWhenDone(callArg) is called
+					// when it completes
     
     void RequestDone();			      // Called by the disk device interrupt
                                   // handler, to signal that the
                                   // current disk operation is complete.
-    // 读者读时申请锁
-    void PlusReader(int sector);
-    // 读者结束读时释放锁
-    void MinusReader(int sector);
-    //写者开始写时申请锁
-    void BeginWrite(int sector);
-    //写者结束写时释放锁
-    void EndWrite(int sector);
-    // 访问当前磁盘扇区的线程
-    int numVisitors[NumSectors];
+    void PlusReader(int sector);	// Take shared access to "sector",
+					// e.g. to read a file header
+    void MinusReader(int sector);	// Give up shared access
+    void BeginWrite(int sector);	// Take exclusive access to "sector"
+    void EndWrite(int sector);		// Give up exclusive access
+
+    void SetJournal(Journal *j) { journal = j; }
+					// Log metadata writes from now on
+    void BeginTransaction();		// Group the metadata writes that
+    void EndTransaction();		// follow; no-ops without a journal
 
   private:
     Disk *disk;		  		          // Raw disk device
-    Semaphore *semaphore; 		    // To synchronize requesting thread 
-					                        // with the interrupt handler
-    Lock *lock;		  		          // Only one read/write request
-					                        // can be sent to the disk at a time
-    // 文件访问信号量
-    Semaphore *mutex[NumSectors];
-    // 读者数量
-    int numReaders[NumSectors];
-    // 读者数量锁
-    Lock* readerLock;
+    DiskRequest *queue;			// requests waiting for the disk
+    int numQueued;			// how many
+    DiskRequest *active;		// request the disk is working on
+
+    void Submit(DiskRequest *request);	// add to queue, start if idle
+    void StartNext();			// pick the next request, C-LOOK
+    void DiskIO(int sector, char* data, bool writing);
+					// raw I/O, waits until done
+
+    Journal *journal;			// Write-ahead log, or NULL
+    Lock *lock;		  		          // Protects the buffer cache
+    RWLock *sectorLock[NumSectors];	// Per-sector reader-writer locks
+
+    int cacheSize;			// number of buffers in "cache"
+    SectorBuffer *cache;		// the buffer cache
+    int slotOf[NumSectors];		// buffer holding each sector, or -1
+    int hand;				// CLOCK hand: next buffer to consider
+
+    SectorBuffer *GetBuffer(int sector, bool overwrite);
+					// find or load "sector"'s buffer
+    SectorBuffer *Recycle(int sector);	// find a free buffer for "sector"
+    void StartIO(SectorBuffer *buf, bool writing);
+    void WaitReady(SectorBuffer *buf);	// wait while "buf" is busy
 };
 
 #endif // SYNCHDISK_H
@@ -0,0 +1,44 @@
+// basicblock.h 
+//	Pre-built basic blocks, for the optional block engine
+//	(Machine::RunBlock).
+//
+//	A block is a straight run of instructions within one physical page,
+//	ending with a branch or jump plus its delay slot, or with an
+//	instruction that always traps.  Each step carries the decoded
+//	instruction and the routine that executes it; steps whose "exec"
+//	is NULL are handed back to OneInstruction.
+//
+//	Kept apart from mipssim.h, whose opcode tables are private to the
+//	simulator, so that machine.cc can manage the block cache.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BASICBLOCK_H
+#define BASICBLOCK_H
+
+#include "copyright.h"
+#include "machine.h"
+
+typedef bool (*BlockHandler)(Machine *m, Instruction *instr, int *pcAfter,
+				int *loadReg, int *loadValue);
+				// execute one instruction; returns FALSE if
+				// it trapped to the kernel instead
+
+struct BlockStep {
+    Instruction instr;		// decoded instruction
+    BlockHandler exec;		// how to run it (NULL: use the interpreter)
+};
+
+class BasicBlock {
+  public:
+    BasicBlock(int len) { length = len; steps = new BlockStep[len]; }
+    ~BasicBlock() { delete [] steps; }
+
+    int version;		// code version of the page when built
+    int length;			// number of instructions
+    BlockStep *steps;
+};
+
+#endif // BASICBLOCK_H
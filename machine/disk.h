@@ -75,6 +75,12 @@ class Disk {
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
 
+    int HeadSector() { return lastSector; }
+					// Where the head is now
+    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
+    int ModuloDiff(int to, int from);        // # sectors between to and from
+					// (public, for request scheduling)
+
   private:
     int fileno;				// UNIX file number for simulated disk 
     VoidFunctionPtr handler;		// Interrupt handler, to be invoked 
@@ -85,8 +91,6 @@ class Disk {
     int bufferInit;			// When the track buffer started 
 					// being loaded
 
-    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
-    int ModuloDiff(int to, int from);        // # sectors between to and from
     void UpdateLast(int newSector);
 };
 
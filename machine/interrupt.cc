@@ -48,6 +48,202 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
     arg = param;
     when = time;
     type = kind;
+    seq = 0;
+    next = NULL;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::PendingQueue
+// 	Initialize an empty queue of pending interrupts.  The heap starts
+//	out big enough for the usual handful of devices, and doubles
+//	whenever it fills up.
+//----------------------------------------------------------------------
+
+PendingQueue::PendingQueue()
+{
+    heapSize = 16;
+    heap = new PendingInterrupt *[heapSize];
+    numPending = 0;
+    nextSeq = 0;
+    freeList = NULL;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::~PendingQueue
+// 	De-allocate the queue, including any interrupts still pending
+//	and all recycled records.
+//----------------------------------------------------------------------
+
+PendingQueue::~PendingQueue()
+{
+    PendingInterrupt *p;
+
+    for (int i = 0; i < numPending; i++)
+	delete heap[i];
+    delete [] heap;
+    while (freeList != NULL) {
+	p = freeList;
+	freeList = p->next;
+	delete p;
+    }
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Alloc/Free
+// 	Get a PendingInterrupt record, reusing one from the free list if
+//	there is any; and give one back once its interrupt has fired.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+PendingQueue::Alloc(VoidFunctionPtr func, int param, int time, IntType kind)
+{
+    PendingInterrupt *p = freeList;
+
+    if (p == NULL)
+	return new PendingInterrupt(func, param, time, kind);
+    freeList = p->next;
+    p->handler = func;
+    p->arg = param;
+    p->when = time;
+    p->type = kind;
+    p->next = NULL;
+    return p;
+}
+
+void
+PendingQueue::Free(PendingInterrupt *toFree)
+{
+    toFree->next = freeList;
+    freeList = toFree;
+}
+
+//----------------------------------------------------------------------
+// Earlier
+// 	Should "a" fire before "b"?  Ties on "when" go to whichever was
+//	scheduled first, as they did with the sorted list.
+//----------------------------------------------------------------------
+
+static bool
+Earlier(PendingInterrupt *a, PendingInterrupt *b)
+{
+    if (a->when != b->when)
+	return (a->when < b->when);
+    return (a->seq < b->seq);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::SiftUp/SiftDown
+// 	Move heap[i] up towards the root, or down towards the leaves,
+//	until it is in heap order again.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::SiftUp(int i)
+{
+    PendingInterrupt *p = heap[i];
+
+    while (i > 0 && Earlier(p, heap[(i - 1) / 2])) {
+	heap[i] = heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    heap[i] = p;
+}
+
+void
+PendingQueue::SiftDown(int i)
+{
+    PendingInterrupt *p = heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < numPending) {
+	if ((child + 1 < numPending) && Earlier(heap[child + 1], heap[child]))
+	    child++;
+	if (!Earlier(heap[child], p))
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = p;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Insert
+// 	Add an interrupt to the queue, growing the heap if it is full.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Insert(PendingInterrupt *toInsert)
+{
+    if (numPending == heapSize) {
+	PendingInterrupt **bigger = new PendingInterrupt *[2 * heapSize];
+
+	for (int i = 0; i < numPending; i++)
+	    bigger[i] = heap[i];
+	delete [] heap;
+	heap = bigger;
+	heapSize *= 2;
+    }
+    toInsert->seq = nextSeq++;
+    heap[numPending++] = toInsert;
+    SiftUp(numPending - 1);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Peek
+// 	Return the interrupt that will fire next, without removing it.
+//	NULL if nothing is pending.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+PendingQueue::Peek()
+{
+    if (numPending == 0)
+	return NULL;
+    return heap[0];
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::RemoveFirst
+// 	Take the interrupt that will fire next off the queue, and return
+//	it.  NULL if nothing is pending.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+PendingQueue::RemoveFirst()
+{
+    PendingInterrupt *first;
+
+    if (numPending == 0)
+	return NULL;
+    first = heap[0];
+    heap[0] = heap[--numPending];
+    if (numPending > 0)
+	SiftDown(0);
+    return first;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Mapcar
+// 	Apply a function to every pending interrupt, in the order they
+//	will fire.  Only used for debugging, so we just sort a copy.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Mapcar(VoidFunctionPtr func)
+{
+    PendingInterrupt **sorted = new PendingInterrupt *[numPending + 1];
+    PendingInterrupt *p;
+    int i, j;
+
+    for (i = 0; i < numPending; i++) {		// insertion sort
+	p = heap[i];
+	for (j = i; j > 0 && Earlier(p, sorted[j - 1]); j--)
+	    sorted[j] = sorted[j - 1];
+	sorted[j] = p;
+    }
+    for (i = 0; i < numPending; i++)
+	(*func)((int)sorted[i]);
+    delete [] sorted;
 }
 
 //----------------------------------------------------------------------
@@ -60,10 +256,11 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    pending = new PendingQueue();
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+    syncing = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -73,8 +270,6 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
     delete pending;
 }
 
@@ -232,16 +427,49 @@ Interrupt::Idle()
         printf("No threads ready or runnable, and no pending interrupts.\n");
         printf("Assuming the program completed.\n");
     }
-    Halt();
+    Halt();				// may return, with a thread to run
 }
 
+#ifdef FILESYS
+//----------------------------------------------------------------------
+// HaltThread
+// 	Body of the thread Halt starts when it is called by Idle.
+//----------------------------------------------------------------------
+static void
+HaltThread(int dummy)
+{
+    interrupt->Halt();
+}
+#endif
+
 //----------------------------------------------------------------------
 // Interrupt::Halt
 // 	Shut down Nachos cleanly, printing out performance statistics.
+//
+//	With a real file system, it is written back first (see Sync),
+//	waiting for the disk like any other I/O, so that it is counted
+//	too.  When Idle calls us, the thread that went to sleep may be
+//	finishing, and can't wait for anything any more: a new thread
+//	does the halting instead, and Idle returns to let it run.  If
+//	Idle calls us while that is going on, the write-back can never
+//	complete, so we give up on it.
 //----------------------------------------------------------------------
 void
 Interrupt::Halt()
 {
+#ifdef FILESYS
+    if (status == IdleMode && !syncing) {
+	status = SystemMode;
+	(new Thread("halt"))->Fork(HaltThread, 0);
+	return;
+    }
+    if (status != IdleMode) {
+	if (syncing)			// another thread is halting
+	    currentThread->Finish();
+	syncing = TRUE;
+	Sync();
+    }
+#endif
     if (VERBOSE) {
         printf("Machine halting!\n\n");
         stats->Print();
@@ -254,7 +482,7 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: just put it on the pending heap.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -269,13 +497,13 @@ void
 Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+    PendingInterrupt *toOccur = pending->Alloc(handler, arg, when, type);
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n", 
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    pending->Insert(toOccur);
 }
 
 //----------------------------------------------------------------------
@@ -301,24 +529,24 @@ Interrupt::CheckIfDue(bool advanceClock)
 					// to invoke an interrupt handler
     if (DebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
+    PendingInterrupt *toOccur = pending->Peek();
 
     if (toOccur == NULL)		// no pending interrupts
 	return FALSE;			
+    when = toOccur->when;
 
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
-	return FALSE;
+    } else if (when > stats->totalTicks) {	// not time yet, leave it
+	return FALSE;				// where it is
     }
+    (void) pending->RemoveFirst();		// it's due; take it off
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
 				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+	 pending->Insert(toOccur);
 	 return FALSE;
     }
 
@@ -335,7 +563,28 @@ Interrupt::CheckIfDue(bool advanceClock)
     (*(toOccur->handler))(toOccur->arg);	// call the interrupt handler
     status = old;				// restore the machine status
     inHandler = FALSE;
-    delete toOccur;
+    pending->Free(toOccur);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NextPending
+// 	Find out when the next scheduled interrupt is due, without
+//	firing or removing it.  Lets the machine simulation run several
+//	user instructions at once when nothing can happen in between.
+//
+// Returns:
+//	TRUE, and the time in *when, if any interrupt is pending
+//----------------------------------------------------------------------
+
+bool
+Interrupt::NextPending(int *when)
+{
+    PendingInterrupt *next = pending->Peek();
+
+    if (next == NULL)
+	return FALSE;
+    *when = next->when;
     return TRUE;
 }
 
@@ -67,6 +67,47 @@ class PendingInterrupt {
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+
+    int seq;			// order of scheduling, so that interrupts
+				// due on the same tick fire first-come,
+				// first-served
+    PendingInterrupt *next;	// link, while on the free list
+};
+
+// The following class holds the interrupts scheduled to occur in the
+// future, as a binary min-heap on (when, seq): scheduling and firing
+// are O(log n), and the next interrupt can be looked at in O(1) without
+// taking it off.  PendingInterrupt records are recycled through a free
+// list, so the steady state does no allocation at all.
+
+class PendingQueue {
+  public:
+    PendingQueue();			// initialize an empty queue
+    ~PendingQueue();			// de-allocate queue and free list
+
+    PendingInterrupt *Alloc(VoidFunctionPtr func, int param, int time,
+				IntType kind);	// get a record, from the
+						// free list if possible
+    void Free(PendingInterrupt *toFree);	// give a record back
+
+    void Insert(PendingInterrupt *toInsert);	// schedule it
+    PendingInterrupt *Peek();		// earliest interrupt, NULL if none;
+					// leave it in the queue
+    PendingInterrupt *RemoveFirst();	// take the earliest one off
+    bool IsEmpty() { return (numPending == 0); }
+
+    void Mapcar(VoidFunctionPtr func);	// apply "func" to every pending
+					// interrupt, in firing order
+
+  private:
+    PendingInterrupt **heap;	// heap[0] fires first
+    int numPending;		// entries in use
+    int heapSize;		// entries allocated
+    int nextSeq;		// sequence number for the next Insert
+    PendingInterrupt *freeList;	// recycled records
+
+    void SiftUp(int i);		// restore heap order around heap[i]
+    void SiftDown(int i);
 };
 
 // The following class defines the data structures for the simulation
@@ -112,14 +153,19 @@ class Interrupt {
     
     void OneTick();       		// Advance simulated time
 
+    bool NextPending(int *when);	// When is the next interrupt due?
+					// FALSE if none is scheduled
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
+    PendingQueue *pending;	// the interrupts scheduled
 				// to occur in the future
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
     MachineStatus status;	// idle, kernel mode, user mode
+    bool syncing;		// TRUE once Halt has started writing
+				// back the file system
 
     // these functions are internal to the interrupt simulation code
 
@@ -10,6 +10,7 @@
 #include "copyright.h"
 #include "machine.h"
 #include "system.h"
+#include "basicblock.h"
 
 // Textual names of the exceptions that can be generated by user program
 // execution, for debugging.
@@ -61,15 +62,37 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
+    decodedCache = new Instruction[MemorySize / 4];
+    decodedValid = new bool[MemorySize / 4];
+    blockCache = new BasicBlock *[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++) {
+	decodedValid[i] = FALSE;
+	blockCache[i] = NULL;
+    }
+    codeVersion = new int[NumPhysPages];
+    pageRefs = new int[NumPhysPages];
+    for (i = 0; i < NumPhysPages; i++)
+	codeVersion[i] = pageRefs[i] = 0;
+    useBlockEngine = FALSE;
+    batchTicks = FALSE;
+    trapped = FALSE;
+    deferredTicks = 0;
+    instrsUntilDue = 0;
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
+    tlb = new TranslationEntry[MaxTLBSize];
+    tlbLastUse = new int[MaxTLBSize];
+    for (i = 0; i < MaxTLBSize; i++) {
 	tlb[i].valid = FALSE;
+	tlbLastUse[i] = 0;
+    }
     pageTable = NULL;
 #else	// use linear page table
     tlb = NULL;
+    tlbLastUse = NULL;
     pageTable = NULL;
 #endif
+    tlbSize = TLBSize;
+    currentASID = 0;
 
     singleStep = debug;
     CheckEndian();
@@ -83,8 +106,18 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
-    if (tlb != NULL)
+    delete [] decodedCache;
+    delete [] decodedValid;
+    for (int i = 0; i < MemorySize / 4; i++)
+	if (blockCache[i] != NULL)
+	    delete blockCache[i];
+    delete [] blockCache;
+    delete [] codeVersion;
+    delete [] pageRefs;
+    if (tlb != NULL) {
         delete [] tlb;
+        delete [] tlbLastUse;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -104,10 +137,87 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
     
 //  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
+    trapped = TRUE;			// tell RunBlock to leave its block
+    CommitTicks();			// the kernel must see the right time
     DelayedLoad(0, 0);			// finish anything in progress
     interrupt->setStatus(SystemMode);
     ExceptionHandler(which);		// interrupts are enabled at this point
     interrupt->setStatus(UserMode);
+    trapped = TRUE;			// other threads may have run, and
+    instrsUntilDue = 0;			// cleared it: the next AdvanceClock
+					// has to tick, and look again at
+					// what is due
+}
+
+//----------------------------------------------------------------------
+// Machine::AdvanceClock
+// 	Account for the user instruction just executed.  Normally this is
+//	just interrupt->OneTick().  In batchTicks mode we only count the
+//	tick, as long as we know that OneTick would find nothing due:
+//	the ticks are added to stats in one go right before the tick on
+//	which the next interrupt fires, or before we trap to the kernel,
+//	so the kernel and the devices see exactly the same times as when
+//	ticking after every instruction.
+//
+//	Returns TRUE if the clock moved by more than this instruction,
+//	i.e. another thread ran and may have changed the address space.
+//----------------------------------------------------------------------
+
+bool
+Machine::AdvanceClock()
+{
+    int when, ticks;
+
+    if (batchTicks && !trapped && (--instrsUntilDue > 0)) {
+	deferredTicks += UserTick;
+	return FALSE;
+    }
+    CommitTicks();
+    ticks = stats->totalTicks;
+    interrupt->OneTick();
+    if (batchTicks) {
+	if (!interrupt->NextPending(&when))	// nothing scheduled: still
+	    instrsUntilDue = TimerTicks / UserTick;	// check now and then
+	else if (when <= stats->totalTicks)
+	    instrsUntilDue = 1;
+	else
+	    instrsUntilDue = divRoundUp(when - stats->totalTicks, UserTick);
+    }
+    return (stats->totalTicks != ticks + UserTick);
+}
+
+//----------------------------------------------------------------------
+// Machine::CommitTicks
+// 	Add the user ticks counted by AdvanceClock to the statistics.
+//----------------------------------------------------------------------
+
+void
+Machine::CommitTicks()
+{
+    stats->totalTicks += deferredTicks;
+    stats->userTicks += deferredTicks;
+    deferredTicks = 0;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedPage
+// 	Throw away the pre-decoded instructions of one physical page.
+//	Stores done by user code through WriteMem invalidate the word
+//	they touch; the kernel must call this whenever it fills a frame
+//	behind the simulator's back (loading a program, paging in).
+//
+//	"frame" -- the physical page number
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecodedPage(int frame)
+{
+    int first = frame * (PageSize / 4);
+
+    ASSERT((frame >= 0) && (frame < NumPhysPages));
+    for (int i = 0; i < PageSize / 4; i++)
+	decodedValid[first + i] = FALSE;
+    codeVersion[frame]++;		// and any blocks built from it
 }
 
 //----------------------------------------------------------------------
@@ -213,16 +323,30 @@ void Machine::WriteRegister(int num, int value)
     }
 
 
+// A frame can be mapped by several page tables at once (copy-on-write
+// after Fork); it is only free once each of them has freed it.
+
 void Machine::FreePage(int n) {
-    freeMap->Clear(n);
+    ASSERT(pageRefs[n] > 0);
+    if (--pageRefs[n] == 0)
+        freeMap->Clear(n);
 }
 
 int Machine::AllocPage() {
     int n = freeMap->Find();
     DEBUG('a', "Allocated page: %d\n", n);
+    if (n >= 0) {
+        pageRefs[n] = 1;
+        InvalidateDecodedPage(n);   // its old contents may have been code
+    }
     return n;
 }
 
+void Machine::SharePage(int n) {
+    ASSERT(pageRefs[n] > 0);
+    pageRefs[n]++;
+}
+
 void Machine::DeallocPageTable() {
     for (int i = 0; i < pageTableSize; ++i) {
         FreePage(pageTable[i].physicalPage);
@@ -35,6 +35,7 @@
 #define NumPhysPages    64
 #define MemorySize 	(NumPhysPages * PageSize)
 #define TLBSize		4		// if there is a TLB, make it small
+#define MaxTLBSize	64		// (but -tlb can make it bigger)
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -71,6 +72,8 @@ enum ExceptionType { NoException,           // Everything ok!
 
 #define NumTotalRegs 	40
 
+class BasicBlock;		// defined in basicblock.h
+
 // The following class defines an instruction, represented in both
 // 	undecoded binary form
 //      decoded to identify
@@ -123,6 +126,11 @@ class Machine {
 
     void OneInstruction(Instruction *instr); 	
     				// Run one instruction of a user program.
+    void RunBlock(Instruction *instr);
+				// Run the basic block at the PC, ticking
+				// the clock after each instruction
+    bool AdvanceClock();	// Account for one user instruction; TRUE
+				// if another thread ran in the meantime
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
     
@@ -145,6 +153,11 @@ class Machine {
 				// Trap to the Nachos kernel, because of a
 				// system call or other exception.  
 
+    void InvalidateDecodedPage(int frame);
+				// Forget cached decodes of a physical page;
+				// call after writing code into mainMemory
+				// directly (not through WriteMem)
+
     void Debugger();		// invoke the user program debugger
     void DumpState();		// print the user CPU and memory state 
 
@@ -180,16 +193,48 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int tlbSize;			// entries of "tlb" in use, TLBSize
+					// unless the kernel says otherwise
+    int currentASID;			// only TLB entries tagged with this
+					// address space ID match
+    int *tlbLastUse;			// when each TLB entry last matched,
+					// counted in TLB hits
 
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
 
+    bool useBlockEngine;	// run user code a basic block at a time
+				// (RunBlock) instead of OneInstruction
+    bool batchTicks;		// only call OneTick when an interrupt
+				// is due, instead of after every
+				// instruction
+
     // Free memory managing
     void FreePage(int n);
     int AllocPage();
+    void SharePage(int n);	// one more page table maps frame "n"
+    int PageRefs(int n) { return pageRefs[n]; }
     void DeallocPageTable();
 
   private:
+    Instruction *decodedCache;	// decoded instruction for each physical
+				// word of mainMemory, filled on first fetch
+    bool *decodedValid;		// is decodedCache[i] up to date?
+    BasicBlock **blockCache;	// block starting at each physical word
+    int *codeVersion;		// bumped whenever code in a page changes
+    int *pageRefs;		// how many page tables map each frame
+    bool trapped;		// set by RaiseException
+    int deferredTicks;		// user ticks not yet added to stats
+    int instrsUntilDue;		// instructions left before OneTick has
+				// anything to do, in batchTicks mode
+
+    void CommitTicks();		// add deferredTicks to stats
+
+    Instruction *DecodedWord(int word);
+				// decoded form of a word of mainMemory
+    BasicBlock *BuildBlock(int physAddr);
+				// decode the block starting at physAddr
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
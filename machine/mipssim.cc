@@ -36,11 +36,21 @@ Machine::Run()
         printf("Starting thread \"%s\" at time %d\n",
 	       currentThread->getName(), stats->totalTicks);
     interrupt->setStatus(UserMode);
+    instrsUntilDue = 0;			// what was due was counted for
+					// the thread that ran before us
     for (;;) {
+	if (useBlockEngine && !singleStep && !DebugIsEnabled('m')) {
+	    RunBlock(instr);
+	    continue;
+	}
+	trapped = FALSE;
         OneInstruction(instr);
-	interrupt->OneTick();
-	if (singleStep && (runUntilTime <= stats->totalTicks))
-	  Debugger();
+	if (singleStep) {
+	    interrupt->OneTick();
+	    if (runUntilTime <= stats->totalTicks)
+		Debugger();
+	} else
+	    AdvanceClock();
     }
 }
 
@@ -93,16 +103,21 @@ TypeToReg(RegType reg, Instruction *instr)
 void
 Machine::OneInstruction(Instruction *instr)
 {
-    int raw;
+    int physAddr;
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
+    ExceptionType exception;
 
-    // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
+    // Fetch instruction.  The PC is still translated every time, so
+    // page faults and use bits behave as before; only the decode is
+    // cached, by physical word, until something writes that word.
+    exception = Translate(registers[PCReg], &physAddr, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
+    }
+    *instr = *DecodedWord(physAddr / 4);
 
     if (DebugIsEnabled('m')) {
        struct OpString *str = &opStrings[instr->opCode];
@@ -564,6 +579,549 @@ Machine::OneInstruction(Instruction *instr)
     registers[NextPCReg] = pcAfter;
 }
 
+//----------------------------------------------------------------------
+// Block handlers
+// 	One routine per common instruction, for the block engine.  Each
+//	does exactly what the matching case of OneInstruction does, but
+//	leaves the delayed load and the PC update to RunBlock.  Anything
+//	rare, or with odd semantics, has no handler and is run by
+//	OneInstruction itself.
+//----------------------------------------------------------------------
+
+static bool
+ExecADD(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int *r = m->registers;
+    int sum = r[in->rs] + r[in->rt];
+
+    if (!((r[in->rs] ^ r[in->rt]) & SIGN_BIT) && ((r[in->rs] ^ sum) & SIGN_BIT)) {
+	m->RaiseException(OverflowException, 0);
+	return FALSE;
+    }
+    r[in->rd] = sum;
+    return TRUE;
+}
+
+static bool
+ExecADDI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int *r = m->registers;
+    int sum = r[in->rs] + in->extra;
+
+    if (!((r[in->rs] ^ in->extra) & SIGN_BIT) && ((in->extra ^ sum) & SIGN_BIT)) {
+	m->RaiseException(OverflowException, 0);
+	return FALSE;
+    }
+    r[in->rt] = sum;
+    return TRUE;
+}
+
+static bool
+ExecADDIU(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rt] = m->registers[in->rs] + in->extra;
+    return TRUE;
+}
+
+static bool
+ExecADDU(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rs] + m->registers[in->rt];
+    return TRUE;
+}
+
+static bool
+ExecAND(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rs] & m->registers[in->rt];
+    return TRUE;
+}
+
+static bool
+ExecANDI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rt] = m->registers[in->rs] & (in->extra & 0xffff);
+    return TRUE;
+}
+
+static bool
+ExecORI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rt] = m->registers[in->rs] | (in->extra & 0xffff);
+    return TRUE;
+}
+
+static bool
+ExecXOR(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rs] ^ m->registers[in->rt];
+    return TRUE;
+}
+
+static bool
+ExecXORI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rt] = m->registers[in->rs] ^ (in->extra & 0xffff);
+    return TRUE;
+}
+
+static bool
+ExecNOR(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = ~(m->registers[in->rs] | m->registers[in->rt]);
+    return TRUE;
+}
+
+static bool
+ExecLUI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rt] = in->extra << 16;
+    return TRUE;
+}
+
+static bool
+ExecSLL(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rt] << in->extra;
+    return TRUE;
+}
+
+static bool
+ExecSLLV(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rt] << (m->registers[in->rs] & 0x1f);
+    return TRUE;
+}
+
+static bool
+ExecSRA(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rt] >> in->extra;
+    return TRUE;
+}
+
+static bool
+ExecSRAV(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rt] >> (m->registers[in->rs] & 0x1f);
+    return TRUE;
+}
+
+static bool
+ExecSRL(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int tmp = m->registers[in->rt];		// same (signed) shift as
+						// OneInstruction does
+    tmp >>= in->extra;
+    m->registers[in->rd] = tmp;
+    return TRUE;
+}
+
+static bool
+ExecSRLV(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int tmp = m->registers[in->rt];
+
+    tmp >>= (m->registers[in->rs] & 0x1f);
+    m->registers[in->rd] = tmp;
+    return TRUE;
+}
+
+static bool
+ExecSLT(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = (m->registers[in->rs] < m->registers[in->rt]) ? 1 : 0;
+    return TRUE;
+}
+
+static bool
+ExecSLTI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rt] = (m->registers[in->rs] < in->extra) ? 1 : 0;
+    return TRUE;
+}
+
+static bool
+ExecSLTIU(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    unsigned int rs = m->registers[in->rs];
+    unsigned int imm = in->extra;
+
+    m->registers[in->rt] = (rs < imm) ? 1 : 0;
+    return TRUE;
+}
+
+static bool
+ExecSLTU(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    unsigned int rs = m->registers[in->rs];
+    unsigned int rt = m->registers[in->rt];
+
+    m->registers[in->rd] = (rs < rt) ? 1 : 0;
+    return TRUE;
+}
+
+static bool
+ExecSUB(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int *r = m->registers;
+    int diff = r[in->rs] - r[in->rt];
+
+    if (((r[in->rs] ^ r[in->rt]) & SIGN_BIT) && ((r[in->rs] ^ diff) & SIGN_BIT)) {
+	m->RaiseException(OverflowException, 0);
+	return FALSE;
+    }
+    r[in->rd] = diff;
+    return TRUE;
+}
+
+static bool
+ExecSUBU(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[in->rs] - m->registers[in->rt];
+    return TRUE;
+}
+
+static bool
+ExecMFHI(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[HiReg];
+    return TRUE;
+}
+
+static bool
+ExecMFLO(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[LoReg];
+    return TRUE;
+}
+
+static bool
+ExecLW(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int addr = m->registers[in->rs] + in->extra;
+    int value;
+
+    if (addr & 0x3) {
+	m->RaiseException(AddressErrorException, addr);
+	return FALSE;
+    }
+    if (!m->ReadMem(addr, 4, &value))
+	return FALSE;
+    *loadReg = in->rt;
+    *loadValue = value;
+    return TRUE;
+}
+
+static bool
+ExecLB(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    int value;
+
+    if (!m->ReadMem(m->registers[in->rs] + in->extra, 1, &value))
+	return FALSE;
+    if ((value & 0x80) && (in->opCode == OP_LB))
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    *loadReg = in->rt;
+    *loadValue = value;
+    return TRUE;
+}
+
+static bool
+ExecSW(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    return m->WriteMem((unsigned) (m->registers[in->rs] + in->extra), 4,
+			m->registers[in->rt]);
+}
+
+static bool
+ExecSB(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    return m->WriteMem((unsigned) (m->registers[in->rs] + in->extra), 1,
+			m->registers[in->rt]);
+}
+
+static bool
+ExecBEQ(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    if (m->registers[in->rs] == m->registers[in->rt])
+	*pcAfter = m->registers[NextPCReg] + IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecBNE(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    if (m->registers[in->rs] != m->registers[in->rt])
+	*pcAfter = m->registers[NextPCReg] + IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecBGEZ(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    if (!(m->registers[in->rs] & SIGN_BIT))
+	*pcAfter = m->registers[NextPCReg] + IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecBGTZ(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    if (m->registers[in->rs] > 0)
+	*pcAfter = m->registers[NextPCReg] + IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecBLEZ(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    if (m->registers[in->rs] <= 0)
+	*pcAfter = m->registers[NextPCReg] + IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecBLTZ(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    if (m->registers[in->rs] & SIGN_BIT)
+	*pcAfter = m->registers[NextPCReg] + IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecJ(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    *pcAfter = (*pcAfter & 0xf0000000) | IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecJAL(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[R31] = m->registers[NextPCReg] + 4;
+    *pcAfter = (*pcAfter & 0xf0000000) | IndexToAddr(in->extra);
+    return TRUE;
+}
+
+static bool
+ExecJR(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    *pcAfter = m->registers[in->rs];
+    return TRUE;
+}
+
+static bool
+ExecJALR(Machine *m, Instruction *in, int *pcAfter, int *loadReg, int *loadValue)
+{
+    m->registers[in->rd] = m->registers[NextPCReg] + 4;
+    *pcAfter = m->registers[in->rs];
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// HandlerFor
+// 	Pick the block handler for a decoded instruction, or NULL to
+//	run it through OneInstruction.  (OR is left to the interpreter
+//	so that both engines compute exactly the same thing.)
+//----------------------------------------------------------------------
+
+static BlockHandler
+HandlerFor(Instruction *instr)
+{
+    switch (instr->opCode) {
+      case OP_ADD:	return ExecADD;
+      case OP_ADDI:	return ExecADDI;
+      case OP_ADDIU:	return ExecADDIU;
+      case OP_ADDU:	return ExecADDU;
+      case OP_AND:	return ExecAND;
+      case OP_ANDI:	return ExecANDI;
+      case OP_ORI:	return ExecORI;
+      case OP_XOR:	return ExecXOR;
+      case OP_XORI:	return ExecXORI;
+      case OP_NOR:	return ExecNOR;
+      case OP_LUI:	return ExecLUI;
+      case OP_SLL:	return ExecSLL;
+      case OP_SLLV:	return ExecSLLV;
+      case OP_SRA:	return ExecSRA;
+      case OP_SRAV:	return ExecSRAV;
+      case OP_SRL:	return ExecSRL;
+      case OP_SRLV:	return ExecSRLV;
+      case OP_SLT:	return ExecSLT;
+      case OP_SLTI:	return ExecSLTI;
+      case OP_SLTIU:	return ExecSLTIU;
+      case OP_SLTU:	return ExecSLTU;
+      case OP_SUB:	return ExecSUB;
+      case OP_SUBU:	return ExecSUBU;
+      case OP_MFHI:	return ExecMFHI;
+      case OP_MFLO:	return ExecMFLO;
+      case OP_LW:	return ExecLW;
+      case OP_LB:
+      case OP_LBU:	return ExecLB;
+      case OP_SW:	return ExecSW;
+      case OP_SB:	return ExecSB;
+      case OP_BEQ:	return ExecBEQ;
+      case OP_BNE:	return ExecBNE;
+      case OP_BGEZ:	return ExecBGEZ;
+      case OP_BGTZ:	return ExecBGTZ;
+      case OP_BLEZ:	return ExecBLEZ;
+      case OP_BLTZ:	return ExecBLTZ;
+      case OP_J:	return ExecJ;
+      case OP_JAL:	return ExecJAL;
+      case OP_JR:	return ExecJR;
+      case OP_JALR:	return ExecJALR;
+      default:		return NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// IsBranch, IsTrap
+// 	Does this instruction end a basic block?  Branches and jumps
+//	end one after their delay slot; traps end one right away.
+//----------------------------------------------------------------------
+
+static bool
+IsBranch(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BNE: case OP_BGEZ: case OP_BGEZAL:
+      case OP_BGTZ: case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL:
+      case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+static bool
+IsTrap(int opCode)
+{
+    return (opCode == OP_SYSCALL) || (opCode == OP_RES) || (opCode == OP_UNIMP);
+}
+
+//----------------------------------------------------------------------
+// Machine::BuildBlock
+// 	Decode the basic block that starts at physical address "physAddr",
+//	going through the decoded-instruction cache so that a later store
+//	into any of its words bumps the page's code version.  A block never
+//	crosses a page boundary, since the next page may map anywhere.
+//----------------------------------------------------------------------
+
+BasicBlock *
+Machine::BuildBlock(int physAddr)
+{
+    int first = physAddr / 4;
+    int pageEnd = (physAddr / PageSize + 1) * (PageSize / 4);
+    int len = 0;
+
+    for (int w = first; w < pageEnd; w++) {
+	Instruction *decoded = DecodedWord(w);
+
+	len++;
+	if (IsTrap(decoded->opCode))
+	    break;
+	if (IsBranch(decoded->opCode)) {
+	    if (w + 1 < pageEnd) {		// take the delay slot along
+		DecodedWord(w + 1);
+		len++;
+	    }
+	    break;
+	}
+    }
+
+    BasicBlock *block = new BasicBlock(len);
+    block->version = codeVersion[physAddr / PageSize];
+    for (int i = 0; i < len; i++) {
+	block->steps[i].instr = decodedCache[first + i];
+	block->steps[i].exec = HandlerFor(&block->steps[i].instr);
+    }
+    if (blockCache[first] != NULL)
+	delete blockCache[first];
+    blockCache[first] = block;
+    DEBUG('m', "Built block at phys 0x%x, %d instructions\n", physAddr, len);
+    return block;
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Run the basic block starting at the current PC, building it first
+//	if need be.  Simulated time, delayed loads, branch delay slots and
+//	exceptions come out exactly as with OneInstruction followed by
+//	AdvanceClock, one instruction at a time; the PC is only translated
+//	on entry to the block.
+//
+//	We leave the block early whenever the instruction stream stops
+//	being sequential (e.g. a block entered at a delay slot), when we
+//	trap to the kernel, when another thread ran (and may have changed
+//	the mappings), or when the block's code was overwritten.
+//
+//	"instr" -- scratch space, as for OneInstruction
+//----------------------------------------------------------------------
+
+void
+Machine::RunBlock(Instruction *instr)
+{
+    int physAddr, pc, page;
+    ExceptionType exception;
+    BasicBlock *block;
+
+    exception = Translate(registers[PCReg], &physAddr, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
+	AdvanceClock();
+	return;
+    }
+    page = physAddr / PageSize;
+    block = blockCache[physAddr / 4];
+    if ((block == NULL) || (block->version != codeVersion[page]))
+	block = BuildBlock(physAddr);
+
+    for (int i = 0; i < block->length; i++) {
+	BlockStep *step = &block->steps[i];
+
+	pc = registers[PCReg];
+	trapped = FALSE;
+	if (step->exec == NULL)
+	    OneInstruction(instr);
+	else {
+	    int pcAfter = registers[NextPCReg] + 4;
+	    int loadReg = 0, loadValue = 0;
+
+	    if ((*step->exec)(this, &step->instr, &pcAfter, &loadReg,
+				&loadValue)) {
+		DelayedLoad(loadReg, loadValue);
+		registers[PrevPCReg] = pc;
+		registers[PCReg] = registers[NextPCReg];
+		registers[NextPCReg] = pcAfter;
+	    }
+	}
+	if (AdvanceClock() || trapped
+		|| (block->version != codeVersion[page])
+		|| (registers[PCReg] != pc + 4))
+	    return;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::DecodedWord
+// 	Return the decoded form of physical word "word" of mainMemory,
+//	decoding it first if it isn't in the cache yet.
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::DecodedWord(int word)
+{
+    if (!decodedValid[word]) {
+	decodedCache[word].value =
+	    WordToHost(*(unsigned int *) &mainMemory[word * 4]);
+	decodedCache[word].Decode();
+	decodedValid[word] = TRUE;
+    }
+    return &decodedCache[word];
+}
+
 //----------------------------------------------------------------------
 // Machine::DelayedLoad
 // 	Simulate effects of a delayed load.
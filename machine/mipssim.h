@@ -11,6 +11,8 @@
 #define MIPSSIM_H
 
 #include "copyright.h"
+#include "machine.h"
+#include "basicblock.h"
 
 /*
  * OpCode values.  The names are straight from the MIPS
@@ -20,8 +20,11 @@ Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
+    numCacheHits = numCacheMisses = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
-    numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numPageFaults = numPageOuts = 0;
+    numTLBHits = numTLBMisses = 0;
+    numPacketsSent = numPacketsRecvd = 0;
 }
 
 //----------------------------------------------------------------------
@@ -36,9 +39,13 @@ Statistics::Print()
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+    printf("Disk cache: hits %d, misses %d\n", numCacheHits, numCacheMisses);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
+    printf("Paging: faults %d, page outs %d\n", numPageFaults, numPageOuts);
+    if (numTLBHits + numTLBMisses > 0)
+	printf("TLB: hits %d, misses %d, hit rate %.2f%%\n", numTLBHits,
+	    numTLBMisses, 100.0 * numTLBHits / (numTLBHits + numTLBMisses));
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
 }
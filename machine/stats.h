@@ -30,9 +30,14 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numCacheHits;		// disk sector requests served by the
+    int numCacheMisses;		// buffer cache, and those that weren't
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPageOuts;		// number of pages written to swap
+    int numTLBHits;		// translations found in the TLB,
+    int numTLBMisses;		// and those that weren't
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
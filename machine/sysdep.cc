@@ -254,6 +254,19 @@ Close(int fd)
     ASSERT(retVal >= 0); 
 }
 
+//----------------------------------------------------------------------
+// Dup
+// 	Open a file again: return a new file descriptor for it.
+//----------------------------------------------------------------------
+
+int
+Dup(int fd)
+{
+    int newFd = dup(fd);
+    ASSERT(newFd >= 0);
+    return newFd;
+}
+
 //----------------------------------------------------------------------
 // Unlink
 // 	Delete a file.
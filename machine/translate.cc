@@ -147,6 +147,10 @@ Machine::WriteMem(int addr, int size, int value)
 	machine->RaiseException(exception, addr);
 	return FALSE;
     }
+    if (decodedValid[physicalAddress / 4]) {	// overwriting code
+	decodedValid[physicalAddress / 4] = FALSE;
+	codeVersion[physicalAddress / PageSize]++;
+    }
     switch (size) {
       case 1:
 	machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
@@ -220,12 +224,15 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	}
 	entry = &pageTable[vpn];
     } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
+        for (entry = NULL, i = 0; i < tlbSize; i++)
+    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)
+			&& (tlb[i].asid == currentASID)) {
 		entry = &tlb[i];			// FOUND!
+		tlbLastUse[i] = ++stats->numTLBHits;
 		break;
 	    }
 	if (entry == NULL) {				// not found
+	    stats->numTLBMisses++;
     	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
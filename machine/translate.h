@@ -40,6 +40,8 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// In the TLB, the address space the entry belongs
+			// to; it only matches while that one is running.
 };
 
 #endif
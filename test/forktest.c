@@ -0,0 +1,67 @@
+/* forktest.c
+ *	Simple program to test Fork, and copy-on-write.
+ *
+ *	After the fork, parent and child both change a global array, and
+ *	each must only ever see its own changes.  The child writes to
+ *	pages that are still shared; the parent writes to some while the
+ *	child still has them, and to the rest after it has exited.
+ */
+
+#include "syscall.h"
+
+#define N 256		/* several pages' worth of ints */
+
+int data[N];
+
+void
+print(char *s)
+{
+    int n = 0;
+
+    while (s[n] != '\0')
+	n++;
+    Write(s, n, ConsoleOutput);
+}
+
+void
+fill(int from, int to, int value)
+{
+    int i;
+
+    for (i = from; i < to; i++)
+	data[i] = value;
+}
+
+int
+check(int from, int to, int value)
+{
+    int i;
+
+    for (i = from; i < to; i++)
+	if (data[i] != value)
+	    return 0;
+    return 1;
+}
+
+int
+main()
+{
+    SpaceId child;
+
+    fill(0, N, 1);
+    child = Fork();
+    if (child == 0) {
+	fill(0, N, 2);
+	print(check(0, N, 2) ? "child: ok\n" : "child: FAILED\n");
+	Exit(0);
+    }
+    fill(0, N / 2, 3);
+    Join(child);
+    fill(N / 2, N, 4);
+    if (check(0, N / 2, 3) && check(N / 2, N, 4))
+	print("parent: ok\n");
+    else
+	print("parent: FAILED\n");
+    Halt();
+    /* not reached */
+}
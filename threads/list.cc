@@ -5,7 +5,10 @@
 // 	A "ListElement" is allocated for each item to be put on the
 //	list; it is de-allocated when the item is removed. This means
 //      we don't need to keep a "next" pointer in every object we
-//      want to put on a list.
+//      want to put on a list.  De-allocated elements are kept on a
+//	free list and handed out again, so a list in steady use (like
+//	the one in a SynchList) stops calling malloc after a while.
+//	Threads waiting on something use a ThreadQueue instead (thread.h).
 // 
 //     	NOTE: Mutual exclusion must be provided by the caller.
 //  	If you want a synchronized list, you must use the routines 
@@ -34,6 +37,35 @@ ListElement::ListElement(void *itemPtr, int sortKey)
      next = NULL;	// assume we'll put it at the end of the list 
 }
 
+//----------------------------------------------------------------------
+// NewElement, FreeElement
+// 	Get a ListElement, recycled if possible; give one back.
+//	The free list is shared by all lists, and linked through "next".
+//----------------------------------------------------------------------
+
+static ListElement *freeElements = NULL;
+
+static ListElement *
+NewElement(void *itemPtr, int sortKey)
+{
+    ListElement *element = freeElements;
+
+    if (element == NULL)
+	return new ListElement(itemPtr, sortKey);
+    freeElements = element->next;
+    element->item = itemPtr;
+    element->key = sortKey;
+    element->next = NULL;
+    return element;
+}
+
+static void
+FreeElement(ListElement *element)
+{
+    element->next = freeElements;
+    freeElements = element;
+}
+
 //----------------------------------------------------------------------
 // List::List
 //	Initialize a list, empty to start with.
@@ -76,7 +108,7 @@ List::~List()
 void
 List::Append(void *item)
 {
-    ListElement *element = new ListElement(item, 0);
+    ListElement *element = NewElement(item, 0);
 
     if (IsEmpty()) {		// list is empty
 	first = element;
@@ -102,7 +134,7 @@ List::Append(void *item)
 void
 List::Prepend(void *item)
 {
-    ListElement *element = new ListElement(item, 0);
+    ListElement *element = NewElement(item, 0);
 
     if (IsEmpty()) {		// list is empty
 	first = element;
@@ -178,7 +210,7 @@ List::IsEmpty()
 void
 List::SortedInsert(void *item, int sortKey)
 {
-    ListElement *element = new ListElement(item, sortKey);
+    ListElement *element = NewElement(item, sortKey);
     ListElement *ptr;		// keep track
 
     if (IsEmpty()) {	// if list is empty, put
@@ -232,7 +264,6 @@ List::SortedRemove(int *keyPtr)
     }
     if (keyPtr != NULL)
         *keyPtr = element->key;
-    delete element;
+    FreeElement(element);
     return thing;
 }
-
@@ -8,9 +8,12 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
-//		-f -cp <unix file> <nachos file>
+// Usage: nachos -d <debugflags> -rs <random seed #> -sched <fifo|mlfq>
+//		-s -bb -bt -x <nachos file> -c <consoleIn> <consoleOut>
+//		-rp <fifo|clock|aging|wsclock> -tlb <entries>
+//		-tlbp <random|fifo|lru> -ipt
+//		-f -dc <cache sectors> -at <seconds>
+//		-cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
 //              -o <other machine id>
@@ -18,15 +21,34 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -sched picks the scheduling policy: fifo (the default), or a
+//	multi-level feedback queue (mlfq), which also starts the timer
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -bb runs user programs with the basic-block engine instead of
+//	decoding and dispatching one instruction at a time
+//    -bt only advances the interrupt simulation when an interrupt is due,
+//	rather than after every user instruction (same simulated timing)
 //    -x runs a user program
 //    -c tests the console
 //
+//  VM
+//    -rp picks the page replacement policy: fifo (the default), clock
+//	(considering dirty bits too), aging (approximate LRU), or wsclock
+//    -tlb sets how many entries the TLB has (with USE_TLB)
+//    -tlbp picks which TLB entry a miss replaces: random, fifo (the
+//	default), or lru
+//    -ipt keeps the translations of all address spaces in one inverted
+//	page table, sized by physical memory, instead of a linear page
+//	table each (with USE_TLB; rejected without it)
+//
 //  FILESYS
 //    -f causes the physical disk to be formatted
+//    -dc sets how many sectors the disk buffer cache holds (0 turns it off)
+//    -at sets how stale (in seconds) a file's access time must be before
+//	a read updates it; 0 updates it on every read
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
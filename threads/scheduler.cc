@@ -11,8 +11,8 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	The order in which ready threads run is up to a SchedulerPolicy:
+//	straight FIFO by default, or a multi-level feedback queue.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,14 +22,20 @@
 #include "scheduler.h"
 #include "system.h"
 
+#include <strings.h>		// for ffs()
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads to empty.
+//
+//	"policy" decides the order threads run in; NULL means plain FIFO.
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedulerPolicy *schedPolicy)
 { 
-    readyList = new List; 
+    if (schedPolicy == NULL)
+	schedPolicy = new FIFOPolicy;
+    policy = schedPolicy;
 } 
 
 //----------------------------------------------------------------------
@@ -39,7 +45,7 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    delete policy; 
 } 
 
 //----------------------------------------------------------------------
@@ -55,8 +61,10 @@ Scheduler::ReadyToRun (Thread *thread)
 {
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
+    if (thread == currentThread)	// yielding: charge it before the
+	Charge(thread);			// policy decides where it goes
     thread->setStatus(READY);
-    readyList->Append((void *)thread);
+    policy->ReadyToRun(thread);
 }
 
 //----------------------------------------------------------------------
@@ -70,7 +78,32 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    return policy->FindNextToRun();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Called from the timer interrupt handler: has the current thread
+//	run long enough that it should be switched out?
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ShouldPreempt()
+{
+    return policy->ShouldPreempt(currentThread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Add the CPU time "thread" used since it was dispatched (or last
+//	charged) to the time it has used at its current priority.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Charge(Thread *thread)
+{
+    thread->ticksAtPriority += stats->totalTicks - thread->lastDispatched;
+    thread->lastDispatched = stats->totalTicks;
 }
 
 //----------------------------------------------------------------------
@@ -101,6 +134,8 @@ Scheduler::Run (Thread *nextThread)
     
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
+    Charge(oldThread);
+    nextThread->lastDispatched = stats->totalTicks;
 
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
@@ -143,5 +178,173 @@ void
 Scheduler::Print()
 {
     printf("Ready list contents:\n");
+    policy->Print();
+}
+
+//----------------------------------------------------------------------
+// FIFOPolicy::FIFOPolicy, ~FIFOPolicy
+// 	Initialize and de-allocate the single FIFO ready queue.
+//----------------------------------------------------------------------
+
+FIFOPolicy::FIFOPolicy()
+{
+    readyList = new ThreadQueue;
+}
+
+FIFOPolicy::~FIFOPolicy()
+{
+    delete readyList;
+}
+
+//----------------------------------------------------------------------
+// FIFOPolicy::ReadyToRun, FindNextToRun, Print
+// 	Threads run in the order they became ready.
+//----------------------------------------------------------------------
+
+void
+FIFOPolicy::ReadyToRun(Thread *thread)
+{
+    readyList->Append(thread);
+}
+
+Thread *
+FIFOPolicy::FindNextToRun()
+{
+    return readyList->Remove();
+}
+
+void
+FIFOPolicy::Print()
+{
     readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
 }
+
+//----------------------------------------------------------------------
+// MLFQPolicy::MLFQPolicy
+// 	Initialize the multi-level feedback queue, all levels empty.
+//----------------------------------------------------------------------
+
+MLFQPolicy::MLFQPolicy()
+{
+    for (int i = 0; i < MLFQLevels; i++)
+	levels[i] = new ThreadQueue;
+    nonEmpty = 0;
+    lastBoost = 0;
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::~MLFQPolicy
+// 	De-allocate the ready queues.
+//----------------------------------------------------------------------
+
+MLFQPolicy::~MLFQPolicy()
+{
+    for (int i = 0; i < MLFQLevels; i++)
+	delete levels[i];
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::ReadyToRun
+// 	Put a thread on the queue for its level, first moving it down a
+//	level if it has used up its allotment at the current one.
+//
+//	"thread" is the thread to be put on the ready list.
+//----------------------------------------------------------------------
+
+void
+MLFQPolicy::ReadyToRun(Thread *thread)
+{
+    if ((thread->ticksAtPriority >= MLFQQuantum(thread->priority))
+		&& (thread->priority < MLFQLevels - 1)) {
+	thread->priority++;
+	thread->ticksAtPriority = 0;
+	DEBUG('t', "Thread %s demoted to level %d\n", thread->getName(),
+		thread->priority);
+    }
+    levels[thread->priority]->Append(thread);
+    nonEmpty |= (1 << thread->priority);
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::FindNextToRun
+// 	Return the first thread on the highest non-empty level, boosting
+//	everybody first if it is time to.  The lowest set bit of
+//	"nonEmpty" is that level.
+//----------------------------------------------------------------------
+
+Thread *
+MLFQPolicy::FindNextToRun()
+{
+    int level;
+    Thread *thread;
+
+    if (stats->totalTicks - lastBoost >= MLFQBoostInterval)
+	Boost();
+    if (nonEmpty == 0)
+	return NULL;
+    level = ffs(nonEmpty) - 1;
+    thread = levels[level]->Remove();
+    if (levels[level]->IsEmpty())
+	nonEmpty &= ~(1 << level);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::ShouldPreempt
+// 	The running thread is switched out once it has used its allotment
+//	at its level, or as soon as a thread at a higher level is ready.
+//
+//	"running" is the thread holding the CPU.
+//----------------------------------------------------------------------
+
+bool
+MLFQPolicy::ShouldPreempt(Thread *running)
+{
+    int used = running->ticksAtPriority
+		+ (stats->totalTicks - running->lastDispatched);
+
+    if (used >= MLFQQuantum(running->priority))
+	return TRUE;
+    return ((nonEmpty & ((1 << running->priority) - 1)) != 0);
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::Boost
+// 	Move every thread back to the top level: the ready ones (keeping
+//	their order, highest level first), and also the running and
+//	blocked ones, via the table of all threads.
+//----------------------------------------------------------------------
+
+void
+MLFQPolicy::Boost()
+{
+    Thread *thread;
+
+    DEBUG('t', "Boosting all threads to level 0\n");
+    for (int i = 1; i < MLFQLevels; i++)
+	while ((thread = levels[i]->Remove()) != NULL)
+	    levels[0]->Append(thread);
+    for (int i = 0; i < MAX_THREAD_COUNT; i++)
+	if (allThreads[i] != NULL) {
+	    allThreads[i]->priority = 0;
+	    allThreads[i]->ticksAtPriority = 0;
+	}
+    nonEmpty = levels[0]->IsEmpty() ? 0 : 1;
+    lastBoost = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::Print
+// 	Print the contents of each non-empty level.
+//----------------------------------------------------------------------
+
+void
+MLFQPolicy::Print()
+{
+    for (int i = 0; i < MLFQLevels; i++)
+	if (nonEmpty & (1 << i)) {
+	    printf("  level %d: ", i);
+	    levels[i]->Mapcar((VoidFunctionPtr) ThreadPrint);
+	    printf("\n");
+	}
+}
@@ -13,13 +13,90 @@
 #include "list.h"
 #include "thread.h"
 
+// The following class defines a scheduling policy -- how the threads
+// that are ready to run are kept, and which one runs next.  The
+// Scheduler does the dispatching and the bookkeeping common to all
+// policies; a new policy only has to implement these routines.
+// All of them are called with interrupts disabled.
+
+class SchedulerPolicy {
+  public:
+    virtual ~SchedulerPolicy() {}
+
+    virtual void ReadyToRun(Thread *thread) = 0;
+					// Put thread on the ready queue(s)
+    virtual Thread *FindNextToRun() = 0;
+					// Take the thread to run next off
+					// the ready queue(s); NULL if none
+    virtual bool ShouldPreempt(Thread *running) = 0;
+					// Called on every timer interrupt:
+					// should "running" give up the CPU?
+    virtual bool NeedsTimer() = 0;	// Does the policy need a timer
+					// even without -rs?
+    virtual void Print() = 0;		// Print the ready queue(s)
+};
+
+// Plain FIFO, the original Nachos policy: one ready queue, and every
+// timer interrupt (if there is a timer) causes a context switch.
+
+class FIFOPolicy : public SchedulerPolicy {
+  public:
+    FIFOPolicy();
+    ~FIFOPolicy();
+
+    void ReadyToRun(Thread *thread);
+    Thread *FindNextToRun();
+    bool ShouldPreempt(Thread *running) { return TRUE; }
+    bool NeedsTimer() { return FALSE; }
+    void Print();
+
+  private:
+    ThreadQueue *readyList;	// queue of threads that are ready to run,
+				// but not running
+};
+
+// Multi-level feedback queue.  Level 0 is the highest priority.  A thread
+// that has used up its allotment of CPU time at a level (over however
+// many turns) moves down one level, where quanta are twice as long;
+// a thread that blocks early keeps its level, so I/O-bound threads stay
+// on top.  Every MLFQBoostInterval ticks, every thread is moved back to
+// level 0, so that CPU-bound threads can't starve.
+//
+// The levels that have ready threads are kept as a bitmap, so picking
+// the next thread is O(1).
+
+#define MLFQLevels		8
+#define MLFQQuantum(level)	(TimerTicks << (level))	// CPU time allowed
+							// at each level
+#define MLFQBoostInterval	(50 * TimerTicks)
+
+class MLFQPolicy : public SchedulerPolicy {
+  public:
+    MLFQPolicy();
+    ~MLFQPolicy();
+
+    void ReadyToRun(Thread *thread);
+    Thread *FindNextToRun();
+    bool ShouldPreempt(Thread *running);
+    bool NeedsTimer() { return TRUE; }
+    void Print();
+
+  private:
+    ThreadQueue *levels[MLFQLevels];	// one ready queue per priority
+    unsigned int nonEmpty;		// bit i set iff levels[i] isn't empty
+    int lastBoost;			// when we last boosted everybody
+
+    void Boost();			// move every thread back to level 0
+};
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
 
 class Scheduler {
   public:
-    Scheduler();			// Initialize list of ready threads 
+    Scheduler(SchedulerPolicy *policy);	// Initialize, with the given
+					// policy (FIFO if NULL)
     ~Scheduler();			// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
@@ -27,10 +104,15 @@ class Scheduler {
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+
+    bool ShouldPreempt();		// Time slice over for currentThread?
+    bool NeedsTimer() { return policy->NeedsTimer(); }
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    SchedulerPolicy *policy;		// how ready threads are queued
+
+    void Charge(Thread *thread);	// account for the CPU time "thread"
+					// used since it was dispatched
 };
 
 #endif // SCHEDULER_H
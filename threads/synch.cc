@@ -1,8 +1,7 @@
 // synch.cc 
-//	Routines for synchronizing threads.  Three kinds of
-//	synchronization routines are defined here: semaphores, locks 
-//   	and condition variables (the implementation of the last two
-//	are left to the reader).
+//	Routines for synchronizing threads.  Four kinds of
+//	synchronization routines are defined here: semaphores, locks,
+//   	condition variables and reader-writer locks.
 //
 // Any implementation of a synchronization routine needs some
 // primitive atomic operation.  We assume Nachos is running on
@@ -37,7 +36,7 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
+    queue = new ThreadQueue;
 }
 
 //----------------------------------------------------------------------
@@ -67,7 +66,7 @@ Semaphore::P()
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
     
     while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+	queue->Append(currentThread);		// so go to sleep
 	currentThread->Sleep();
     } 
     value--; 					// semaphore available, 
@@ -90,23 +89,299 @@ Semaphore::V()
     Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    thread = (Thread *)queue->Remove();
+    thread = queue->Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
     value++;
     (void) interrupt->SetLevel(oldLevel);
 }
 
-// Dummy functions -- so we can compile our later assignments 
-// Note -- without a correct implementation of Condition::Wait(), 
-// the test case in the network assignment won't work!
-Lock::Lock(char* debugName) {}
-Lock::~Lock() {}
-void Lock::Acquire() {}
-void Lock::Release() {}
+//----------------------------------------------------------------------
+// Lock::Lock
+// 	Initialize a lock, so that it can be used for synchronization.
+//	The lock starts out FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+Lock::Lock(char* debugName)
+{
+    name = debugName;
+    owner = NULL;
+    queue = new ThreadQueue;
+}
+
+//----------------------------------------------------------------------
+// Lock::~Lock
+// 	De-allocate a lock, when no longer needed.  Assume no one
+//	is holding it or waiting for it!
+//----------------------------------------------------------------------
+
+Lock::~Lock()
+{
+    ASSERT(owner == NULL);
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// Lock::Acquire
+// 	Wait until the lock is FREE, then make the current thread its
+//	owner.  A thread that has to wait is woken up by Release only once
+//	the lock has been handed to it, so there is no re-check.
+//----------------------------------------------------------------------
+
+void
+Lock::Acquire()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(!isHeldByCurrentThread());		// no recursive locking
+    if (owner == NULL)
+	owner = currentThread;
+    else {
+	queue->Append(currentThread);
+	currentThread->Sleep();
+	ASSERT(owner == currentThread);		// handed over by Release
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::Release
+// 	Give up the lock.  If anybody is waiting, the first waiter becomes
+//	the owner right away and is made ready to run; otherwise the lock
+//	is FREE.  Handing the lock over means nobody can barge in between.
+//----------------------------------------------------------------------
+
+void
+Lock::Release()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(isHeldByCurrentThread());
+    owner = queue->Remove();
+    if (owner != NULL)
+	scheduler->ReadyToRun(owner);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::isHeldByCurrentThread
+// 	Return TRUE if the current thread holds the lock.
+//----------------------------------------------------------------------
+
+bool
+Lock::isHeldByCurrentThread()
+{
+    return (owner == currentThread);
+}
+
+//----------------------------------------------------------------------
+// Condition::Condition
+// 	Initialize a condition variable, with no one waiting.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+Condition::Condition(char* debugName)
+{
+    name = debugName;
+    queue = new ThreadQueue;
+}
+
+//----------------------------------------------------------------------
+// Condition::~Condition
+// 	De-allocate a condition variable.  Assume no one is waiting.
+//----------------------------------------------------------------------
+
+Condition::~Condition()
+{
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// Condition::Wait
+// 	Atomically release "conditionLock" and go to sleep until signaled.
+//	By the time we run again, Signal has moved us to the lock's queue
+//	and Release has given us the lock, so we return holding it.
+//
+//	"conditionLock" must be held by the current thread.
+//----------------------------------------------------------------------
+
+void
+Condition::Wait(Lock* conditionLock)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    queue->Append(currentThread);
+    conditionLock->Release();
+    currentThread->Sleep();
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::Signal
+// 	Wake up one waiter, if any.  Since the signaller holds the lock,
+//	the waiter couldn't run yet anyway: instead of putting it on the
+//	ready list, only to block again in Acquire, move it directly onto
+//	the lock's queue ("wait morphing").
+//
+//	"conditionLock" must be held by the current thread.
+//----------------------------------------------------------------------
+
+void
+Condition::Signal(Lock* conditionLock)
+{
+    Thread *thread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    thread = queue->Remove();
+    if (thread != NULL)
+	conditionLock->queue->Append(thread);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::Broadcast
+// 	Wake up all waiters, moving them onto the lock's queue in order.
+//
+//	"conditionLock" must be held by the current thread.
+//----------------------------------------------------------------------
+
+void
+Condition::Broadcast(Lock* conditionLock)
+{
+    Thread *thread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    while ((thread = queue->Remove()) != NULL)
+	conditionLock->queue->Append(thread);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, with no readers or writer.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    name = debugName;
+    readers = 0;
+    writer = NULL;
+    waitingReaders = new ThreadQueue;
+    waitingWriters = new ThreadQueue;
+}
 
-Condition::Condition(char* debugName) { }
-Condition::~Condition() { }
-void Condition::Wait(Lock* conditionLock) { ASSERT(FALSE); }
-void Condition::Signal(Lock* conditionLock) { }
-void Condition::Broadcast(Lock* conditionLock) { }
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	De-allocate a reader-writer lock.  Assume no one is holding it
+//	or waiting for it!
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers == 0 && writer == NULL);
+    delete waitingReaders;
+    delete waitingWriters;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+// 	Wait until no writer holds or is waiting for the lock, then join
+//	the readers.  A reader that has to wait is counted in by
+//	ReleaseWrite before it is woken up.
+//----------------------------------------------------------------------
+
+void
+RWLock::AcquireRead()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(writer != currentThread);
+    if (writer == NULL && waitingWriters->IsEmpty())
+	readers++;
+    else {
+	waitingReaders->Append(currentThread);
+	currentThread->Sleep();
+	ASSERT(writer == NULL && readers > 0);	// admitted by ReleaseWrite
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseRead
+// 	Leave the readers.  The last reader out hands the lock to the
+//	first waiting writer, if any.
+//----------------------------------------------------------------------
+
+void
+RWLock::ReleaseRead()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(readers > 0 && writer == NULL);
+    if (--readers == 0) {
+	writer = waitingWriters->Remove();
+	if (writer != NULL)
+	    scheduler->ReadyToRun(writer);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+// 	Wait until the lock is FREE, then make the current thread the
+//	writer.  As in Lock::Acquire, a waiting writer only wakes up once
+//	the lock has been handed to it.
+//----------------------------------------------------------------------
+
+void
+RWLock::AcquireWrite()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(writer != currentThread);
+    if (writer == NULL && readers == 0)
+	writer = currentThread;
+    else {
+	waitingWriters->Append(currentThread);
+	currentThread->Sleep();
+	ASSERT(writer == currentThread);	// handed over on release
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+// 	Give up exclusive access.  If readers queued up meanwhile, admit
+//	all of them at once; otherwise hand the lock to the next writer.
+//	Alternating this way keeps either side from starving the other.
+//----------------------------------------------------------------------
+
+void
+RWLock::ReleaseWrite()
+{
+    Thread *thread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(writer == currentThread);
+    writer = NULL;
+    if (!waitingReaders->IsEmpty()) {
+	while ((thread = waitingReaders->Remove()) != NULL) {
+	    readers++;
+	    scheduler->ReadyToRun(thread);
+	}
+    } else {
+	writer = waitingWriters->Remove();
+	if (writer != NULL)
+	    scheduler->ReadyToRun(writer);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
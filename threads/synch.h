@@ -1,11 +1,10 @@
 // synch.h 
 //	Data structures for synchronizing threads.
 //
-//	Three kinds of synchronization are defined here: semaphores,
-//	locks, and condition variables.  The implementation for
-//	semaphores is given; for the latter two, only the procedure
-//	interface is given -- they are to be implemented as part of 
-//	the first assignment.
+//	Four kinds of synchronization are defined here: semaphores,
+//	locks, condition variables and reader-writer locks.  Semaphores
+//	came with Nachos; the other three are built the same way, on
+//	disabling interrupts and queues of waiting threads.
 //
 //	Note that all the synchronization objects take a "name" as
 //	part of the initialization.  This is solely for debugging purposes.
@@ -48,7 +47,7 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    ThreadQueue *queue; // threads waiting in P() for the value to be > 0
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -60,8 +59,10 @@ class Semaphore {
 //		in Acquire if necessary
 //
 // In addition, by convention, only the thread that acquired the lock
-// may release it.  As with semaphores, you can't read the lock value
-// (because the value might change immediately after you read it).  
+// may release it.  Release hands the lock directly to the thread that
+// has waited longest, so waiters get the lock in FIFO order.  As with
+// semaphores, you can't read the lock value (because the value might
+// change immediately after you read it).  
 
 class Lock {
   public:
@@ -79,7 +80,11 @@ class Lock {
 
   private:
     char* name;				// for debugging
-    // plus some other stuff you'll need to define
+    Thread *owner;			// thread holding the lock, NULL if FREE
+    ThreadQueue *queue;			// threads waiting in Acquire()
+
+    friend class Condition;		// Signal moves its waiters straight
+					// onto "queue"
 };
 
 // The following class defines a "condition variable".  A condition
@@ -104,11 +109,15 @@ class Lock {
 // semantics.  When a Signal or Broadcast wakes up another thread,
 // it simply puts the thread on the ready list, and it is the responsibility
 // of the woken thread to re-acquire the lock (this re-acquire is
-// taken care of within Wait()).  By contrast, some define condition
-// variables according to *Hoare*-style semantics -- where the signalling
-// thread gives up control over the lock and the CPU to the woken thread,
-// which runs immediately and gives back control over the lock to the 
-// signaller when the woken thread leaves the critical section.
+// taken care of within Wait()).  (Our implementation does the
+// re-acquire on the waiter's behalf: Signal moves it from the condition
+// straight onto the lock's queue, and Release hands it the lock, so it
+// wakes up only once, already holding the lock.)  By contrast, some
+// define condition variables according to *Hoare*-style semantics --
+// where the signalling thread gives up control over the lock and the
+// CPU to the woken thread, which runs immediately and gives back control
+// over the lock to the signaller when the woken thread leaves the
+// critical section.
 //
 // The consequence of using Mesa-style semantics is that some other thread
 // can acquire the lock, and change data structures, before the woken
@@ -131,6 +140,43 @@ class Condition {
 
   private:
     char* name;
-    // plus some other stuff you'll need to define
+    ThreadQueue *queue;			// threads waiting in Wait()
+};
+
+// The following class defines a "reader-writer lock".  Any number of
+// readers may hold the lock at the same time, but a writer holds it
+// alone:
+//
+//	AcquireRead/ReleaseRead -- shared access
+//
+//	AcquireWrite/ReleaseWrite -- exclusive access
+//
+// Writers are preferred: once a writer is waiting, new readers queue up
+// behind it, so a steady stream of readers can't starve it.  In turn,
+// when a writer releases the lock, every reader that queued up while
+// it was held is admitted before the next writer, so readers can't be
+// starved by a stream of writers either.  Like Lock, the lock is
+// handed directly to the threads being woken up.
+//
+// A thread must not acquire the lock again (in either mode) while it
+// already holds it: a writer waiting in between would deadlock it.
+
+class RWLock {
+  public:
+    RWLock(char* debugName);		// initialize lock to be FREE
+    ~RWLock();				// deallocate lock
+    char* getName() { return name; }	// debugging assist
+
+    void AcquireRead();			// shared access
+    void ReleaseRead();
+    void AcquireWrite();		// exclusive access
+    void ReleaseWrite();
+
+  private:
+    char* name;				// for debugging
+    int readers;			// number of readers holding the lock
+    Thread *writer;			// writer holding the lock, or NULL
+    ThreadQueue *waitingReaders;	// threads waiting in AcquireRead()
+    ThreadQueue *waitingWriters;	// threads waiting in AcquireWrite()
 };
 #endif // SYNCH_H
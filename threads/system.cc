@@ -7,6 +7,9 @@
 
 #include "copyright.h"
 #include "system.h"
+#ifdef FILESYS
+#include "filehdr.h"
+#endif
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -27,12 +30,22 @@ FileSystem  *fileSystem;
 
 #ifdef FILESYS
 SynchDisk   *synchDisk;
+InodeTable  *inodeTable;
 #endif
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
 Machine *machine;	// user program memory and registers
 #endif
 
+#ifdef VM
+CoreMap *coreMap;
+#endif
+
+#ifdef USE_TLB
+TLBManager *tlbManager;
+InvertedPageTable *invertedPageTable;
+#endif
+
 #ifdef NETWORK
 PostOffice *postOffice;
 #endif
@@ -64,7 +77,7 @@ Thread *allThreads[MAX_THREAD_COUNT];
 static void
 TimerInterruptHandler(int dummy)
 {
-    if (interrupt->getStatus() != IdleMode)
+    if ((interrupt->getStatus() != IdleMode) && scheduler->ShouldPreempt())
 	interrupt->YieldOnReturn();
 }
 
@@ -84,13 +97,28 @@ Initialize(int argc, char **argv)
     int argCount;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    SchedulerPolicy *policy = NULL;	// FIFO unless -sched says otherwise
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    bool blockEngine = FALSE;	// run user code a basic block at a time
+    bool batchTicks = FALSE;	// only tick when an interrupt is due
+#endif
+#ifdef VM
+    ReplacementPolicy *replacement = NULL;	// FIFO unless -rp says
+						// otherwise
+#endif
+#ifdef USE_TLB
+    int tlbSize = TLBSize;		// entries in the TLB
+    TLBReplacement tlbReplacement = TLBFIFO;
+    bool useInvertedPageTable = FALSE;
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
 #endif
+#ifdef FILESYS
+    int cacheSize = DefaultCacheSize;	// sectors in the disk buffer cache
+#endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
     int netname = 0;		// UNIX socket name
@@ -111,15 +139,76 @@ Initialize(int argc, char **argv)
 						// number generator
 	    randomYield = TRUE;
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-sched")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "mlfq"))
+		policy = new MLFQPolicy;
+	    else
+		ASSERT_MSG(!strcmp(*(argv + 1), "fifo"),
+			"Scheduling policy must be fifo or mlfq.");
+	    argCount = 2;
 	}
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = TRUE;
+	else if (!strcmp(*argv, "-bb"))
+	    blockEngine = TRUE;
+	else if (!strcmp(*argv, "-bt"))
+	    batchTicks = TRUE;
+#endif
+#ifdef VM
+	if (!strcmp(*argv, "-rp")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "clock"))
+		replacement = new ClockReplacement;
+	    else if (!strcmp(*(argv + 1), "aging"))
+		replacement = new AgingReplacement;
+	    else if (!strcmp(*(argv + 1), "wsclock"))
+		replacement = new WSClockReplacement;
+	    else
+		ASSERT_MSG(!strcmp(*(argv + 1), "fifo"),
+			"Page replacement policy must be fifo, clock, aging or wsclock.");
+	    argCount = 2;
+	}
+#endif
+#ifdef USE_TLB
+	if (!strcmp(*argv, "-tlb")) {
+	    ASSERT(argc > 1);
+	    tlbSize = atoi(*(argv + 1));
+	    ASSERT_MSG(tlbSize > 0 && tlbSize <= MaxTLBSize,
+			"TLB size must be between 1 and MaxTLBSize.");
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-tlbp")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "random"))
+		tlbReplacement = TLBRandom;
+	    else if (!strcmp(*(argv + 1), "lru"))
+		tlbReplacement = TLBLRU;
+	    else
+		ASSERT_MSG(!strcmp(*(argv + 1), "fifo"),
+			"TLB replacement must be random, fifo or lru.");
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-ipt"))
+	    useInvertedPageTable = TRUE;
+#else
+	if (!strcmp(*argv, "-ipt"))	// only a TLB can be refilled from it
+	    ASSERT_MSG(FALSE, "-ipt needs a TLB (USE_TLB).");
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
 	    format = TRUE;
 #endif
+#ifdef FILESYS
+	if (!strcmp(*argv, "-dc")) {
+	    ASSERT(argc > 1);
+	    cacheSize = atoi(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-at")) {
+	    ASSERT(argc > 1);
+	    accessTimeDelay = atoi(*(argv + 1));
+	    argCount = 2;
+	}
+#endif
 #ifdef NETWORK
 	if (!strcmp(*argv, "-l")) {
 	    ASSERT(argc > 1);
@@ -136,9 +225,9 @@ Initialize(int argc, char **argv)
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
-    scheduler = new Scheduler();		// initialize the ready queue
+    scheduler = new Scheduler(policy);		// initialize the ready queue
     freeMap = new BitMap(NumPhysPages);
-    if (randomYield)				// start the timer (if needed)
+    if (randomYield || scheduler->NeedsTimer())	// start the timer (if needed)
 	timer = new Timer(TimerInterruptHandler, 0, randomYield);
 
     threadToBeDestroyed = NULL;
@@ -154,10 +243,26 @@ Initialize(int argc, char **argv)
     
 #ifdef USER_PROGRAM
     machine = new Machine(debugUserProg);	// this must come first
+    machine->useBlockEngine = blockEngine;
+    machine->batchTicks = batchTicks && !DebugIsEnabled('i');
+					// 'i' traces every single tick
+#endif
+
+#ifdef VM
+    coreMap = new CoreMap(replacement);
+#endif
+
+#ifdef USE_TLB
+    machine->tlbSize = tlbSize;
+    tlbManager = new TLBManager(tlbReplacement);
+    invertedPageTable = NULL;
+    if (useInvertedPageTable)
+	invertedPageTable = new InvertedPageTable;
 #endif
 
 #ifdef FILESYS
-    synchDisk = new SynchDisk("DISK");
+    synchDisk = new SynchDisk("DISK", cacheSize);
+    inodeTable = new InodeTable;
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -169,6 +274,22 @@ Initialize(int argc, char **argv)
 #endif
 }
 
+//----------------------------------------------------------------------
+// Sync
+// 	Write back what the file system still holds in memory: the
+//	changed headers of files that are still open, then the buffer
+//	cache.  Called by Interrupt::Halt, from a thread that can wait
+//	for the disk.
+//----------------------------------------------------------------------
+void
+Sync()
+{
+#ifdef FILESYS
+    inodeTable->Flush();
+    synchDisk->Flush();
+#endif
+}
+
 //----------------------------------------------------------------------
 // Cleanup
 // 	Nachos is halting.  De-allocate global data structures.
@@ -181,6 +302,15 @@ Cleanup()
     delete postOffice;
 #endif
     
+#ifdef USE_TLB
+    delete tlbManager;
+    delete invertedPageTable;
+#endif
+
+#ifdef VM
+    delete coreMap;
+#endif
+
 #ifdef USER_PROGRAM
     delete machine;
 #endif
@@ -23,6 +23,8 @@ extern void Initialize(int argc, char **argv); 	// Initialization,
 						// called before anything else
 extern void Cleanup();				// Cleanup, called when
 						// Nachos is done.
+extern void Sync();				// Write back the file
+						// system, as Nachos halts
 
 extern Thread *currentThread;			// the thread holding the CPU
 extern Thread *threadToBeDestroyed;  		// the thread that just finished
@@ -43,6 +45,20 @@ extern BitMap *freeMap;
 extern Machine* machine;	// user program memory and registers
 #endif
 
+#ifdef VM
+#include "coremap.h"
+extern CoreMap *coreMap;	// who holds each physical frame
+#endif
+
+#ifdef USE_TLB
+#include "tlbmanager.h"
+#include "ipt.h"
+extern TLBManager *tlbManager;	// refills the TLB
+extern InvertedPageTable *invertedPageTable;	// NULL unless -ipt: then
+						// used instead of per
+						// address space tables
+#endif
+
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
 #include "filesys.h"
 extern FileSystem  *fileSystem;
@@ -51,6 +67,7 @@ extern FileSystem  *fileSystem;
 #ifdef FILESYS
 #include "synchdisk.h"
 extern SynchDisk   *synchDisk;
+extern InodeTable  *inodeTable;
 #endif
 
 #ifdef NETWORK
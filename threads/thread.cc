@@ -43,6 +43,11 @@ Thread::Thread(char* threadName)
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
+    queueNext = NULL;
+    queued = FALSE;
+    priority = 0;
+    ticksAtPriority = 0;
+    lastDispatched = 0;
     uid = getuid();
     tid = incrementalTID++;
     insertToThreads();
@@ -66,6 +71,7 @@ Thread::~Thread()
     DEBUG('t', "Deleting thread \"%s\"\n", name);
 
     ASSERT(this != currentThread);
+    ASSERT(!queued);
     removeFromThreads();
     delete cwd;
     if (stack != NULL)
@@ -164,10 +170,11 @@ Thread::Finish ()
 //----------------------------------------------------------------------
 // Thread::Yield
 // 	Relinquish the CPU if any other thread is ready to run.
-//	If so, put the thread on the end of the ready list, so that
-//	it will eventually be re-scheduled.
+//	The thread is put back on the ready list first, so that the
+//	scheduling policy weighs it against the others; if the policy
+//	still picks it, it keeps the CPU.
 //
-//	NOTE: returns immediately if no other thread on the ready queue.
+//	NOTE: returns immediately if no other thread should run first.
 //	Otherwise returns when the thread eventually works its way
 //	to the front of the ready list and gets re-scheduled.
 //
@@ -189,11 +196,12 @@ Thread::Yield ()
     
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
     
-    nextThread = scheduler->FindNextToRun();
-    if (nextThread != NULL) {
-	scheduler->ReadyToRun(this);
+    scheduler->ReadyToRun(this);
+    nextThread = scheduler->FindNextToRun();	// at least "this" is ready
+    if (nextThread != this)
 	scheduler->Run(nextThread);
-    }
+    else
+	setStatus(RUNNING);
     (void) interrupt->SetLevel(oldLevel);
 }
 
@@ -395,4 +403,101 @@ Thread::printTS()
                    status);
         }
     }
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::ThreadQueue
+// 	Initialize a queue of threads to be empty.
+//----------------------------------------------------------------------
+
+ThreadQueue::ThreadQueue()
+{
+    first = last = NULL;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::~ThreadQueue
+// 	De-allocate a queue of threads.  Since the links live in the
+//	threads themselves, there is nothing to free; nobody should
+//	still be waiting.
+//----------------------------------------------------------------------
+
+ThreadQueue::~ThreadQueue()
+{
+    ASSERT(IsEmpty());
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Append
+// 	Put a thread at the end of the queue.
+//
+//	"thread" is the thread to be put on the queue.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Append(Thread *thread)
+{
+    ASSERT(!thread->queued);
+    thread->queued = TRUE;
+    thread->queueNext = NULL;
+    if (first == NULL)
+	first = thread;
+    else
+	last->queueNext = thread;
+    last = thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Prepend
+// 	Put a thread at the front of the queue.
+//
+//	"thread" is the thread to be put on the queue.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Prepend(Thread *thread)
+{
+    ASSERT(!thread->queued);
+    thread->queued = TRUE;
+    thread->queueNext = first;
+    first = thread;
+    if (last == NULL)
+	last = thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Remove
+// 	Take the first thread off the queue.
+//
+// Returns:
+//	The thread, or NULL if the queue was empty.
+//----------------------------------------------------------------------
+
+Thread *
+ThreadQueue::Remove()
+{
+    Thread *thread = first;
+
+    if (thread == NULL)
+	return NULL;
+    first = thread->queueNext;
+    if (first == NULL)
+	last = NULL;
+    thread->queueNext = NULL;
+    thread->queued = FALSE;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Mapcar
+// 	Apply a function to each thread on the queue, in order.
+//
+//	"func" is the procedure to apply to each thread.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Mapcar(VoidFunctionPtr func)
+{
+    for (Thread *t = first; t != NULL; t = t->queueNext)
+	(*func)((int)t);
+}
@@ -145,6 +145,41 @@ public:
 
     static void printTS();
     char *cwd;
+
+    // Scheduling state, kept up to date by the Scheduler (scheduler.cc)
+    int priority;		// MLFQ level; 0 is the highest
+    int ticksAtPriority;	// CPU time used at that level so far
+    int lastDispatched;		// when the thread last got the CPU
+
+    // Link for the one ThreadQueue (the ready queue, or the wait queue
+    // of some synchronization object) the thread may be on.
+    Thread *queueNext;		// next thread on the same queue
+    bool queued;		// is the thread on a queue right now?
+};
+
+// The following class defines a FIFO queue of threads that is threaded
+// through the threads themselves ("queueNext"), so that putting a thread
+// on the ready list or a wait queue, and taking it off again, never
+// allocates memory.  A thread can be on at most one queue at a time,
+// which is always the case: it is either ready, or waiting for one thing.
+//
+// As with List, the caller provides mutual exclusion (interrupts off).
+
+class ThreadQueue {
+  public:
+    ThreadQueue();			// initialize an empty queue
+    ~ThreadQueue();			// the queue had better be empty
+
+    void Append(Thread *thread);	// put thread at the end
+    void Prepend(Thread *thread);	// put thread at the front
+    Thread *Remove();			// take the first thread off;
+					// NULL if the queue is empty
+    bool IsEmpty() { return (first == NULL); }
+    void Mapcar(VoidFunctionPtr func);	// apply "func" to every thread
+
+  private:
+    Thread *first;			// head of the queue, NULL if empty
+    Thread *last;			// last thread on the queue
 };
 
 // Magical machine-dependent routines, defined in switch.s
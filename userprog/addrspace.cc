@@ -44,6 +44,12 @@ SwapHeader (NoffHeader *noffH)
 	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
 }
 
+#ifdef VM
+static int nextSwapId = 0;		// to name each address space's
+					// swap file
+
+#endif // VM
+
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
@@ -56,13 +62,21 @@ SwapHeader (NoffHeader *noffH)
 //	memory.  For now, this is really simple (1:1), since we are
 //	only uniprogramming, and we have a single unsegmented page table
 //
+//	With virtual memory, nothing is loaded yet: every page starts out
+//	invalid, and is paged in from the executable (or, once it has been
+//	changed and paged out, from our swap file) when it is first used.
+//	The executable stays open for that; otherwise it is closed here.
+//
 //	"executable" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace(OpenFile *executable)
 {
+#ifndef VM
     NoffHeader noffH;
-    unsigned int i, size;
+    unsigned int i;
+#endif
+    unsigned int size;
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
     if ((noffH.noffMagic != NOFFMAGIC) &&
@@ -77,6 +91,12 @@ AddrSpace::AddrSpace(OpenFile *executable)
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
 
+#ifdef VM
+    DEBUG('a', "Initializing address space, num pages %d, size %d, "
+                "paged on demand\n", numPages, size);
+    InitPaging();
+    execFile = executable;
+#else
     ASSERT(numPages <= NumPhysPages);		// check we're not trying
 						// to run anything too big --
 						// at least until we have
@@ -86,7 +106,9 @@ AddrSpace::AddrSpace(OpenFile *executable)
 					numPages, size);
 // first, set up the translation 
     pageTable = new TranslationEntry[numPages];
+    copyOnWrite = new bool[numPages];
     for (i = 0; i < numPages; i++) {
+        copyOnWrite[i] = FALSE;
         pageTable[i].virtualPage = i;	// for now, virtual page # = phys page #
         pageTable[i].physicalPage = machine->AllocPage();
         pageTable[i].valid = TRUE;
@@ -113,7 +135,70 @@ AddrSpace::AddrSpace(OpenFile *executable)
 			noffH.initData.virtualAddr, noffH.initData.size);
         MapSegment(noffH.initData, executable);
     }
+    delete executable;			// everything is in memory now
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+// 	Create a copy of address space "parent", for Fork.
+//
+//	Nothing is copied yet: both map the same frames, made read-only,
+//	and whichever writes to one first gets its own copy of it then
+//	(see CopyOnWrite).  Each frame counts how many page tables map it.
+//
+//	With virtual memory, frames have a single owner, so they can't be
+//	shared.  Pages the parent has never changed still are what the
+//	executable says, so we page them in from our own copy of it, like
+//	the parent does.  Only the pages it has changed -- dirty in
+//	memory, or saved to its swap file -- are copied now, into our swap
+//	file.  (A page being written to the parent's swap just now counts
+//	as saved already, and ReadPage waits for the write.)
+//----------------------------------------------------------------------
 
+AddrSpace::AddrSpace(AddrSpace *parent)
+{
+    unsigned int i;
+
+    numPages = parent->numPages;
+#ifdef VM
+    char page[PageSize];
+    TranslationEntry *entry;
+
+    DEBUG('a', "Forking address space, num pages %d, changed pages "
+                "into swap\n", numPages);
+    noffH = parent->noffH;
+    InitPaging();
+    execFile = parent->execFile->Reopen();
+#ifdef USE_TLB
+    tlbManager->SyncAll();		// the parent's dirty bits
+#endif
+    for (i = 0; i < numPages; i++) {
+        entry = parent->Resident(i);
+        if (parent->inSwap[i] || (entry != NULL && entry->dirty)) {
+            parent->ReadPage(i, page);
+            WriteSwap(i, page);
+        }
+    }
+#else
+    DEBUG('a', "Forking address space, num pages %d, copy on write\n",
+                numPages);
+    pageTable = new TranslationEntry[numPages];
+    copyOnWrite = new bool[numPages];
+    for (i = 0; i < numPages; i++) {
+        TranslationEntry *entry = &parent->pageTable[i];
+
+        if (!entry->readOnly) {		// the parent's mapping changes
+            entry->readOnly = TRUE;	// too, even while it runs
+            parent->copyOnWrite[i] = TRUE;
+        }
+        pageTable[i] = *entry;
+        pageTable[i].use = FALSE;
+        pageTable[i].dirty = FALSE;
+        copyOnWrite[i] = parent->copyOnWrite[i];
+        machine->SharePage(entry->physicalPage);
+    }
+#endif
 }
 
 void AddrSpace::MapSegment(Segment seg, OpenFile *executable) {
@@ -152,11 +237,26 @@ void AddrSpace::MapSegment(Segment seg, OpenFile *executable) {
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.  Nothing for now!
+// 	Dealloate an address space.  With virtual memory, that means giving
+//	back our frames, and closing and removing the files we page from.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
+#ifdef VM
+#ifdef USE_TLB
+    tlbManager->FreeASID(asid);
+#endif
+    coreMap->FreeFrames(this);		// waits for any page out of ours
+    delete execFile;
+    if (swapFile != NULL) {
+        delete swapFile;
+        fileSystem->Remove(swapName);
+    }
+    delete [] inSwap;
+#else
+    delete [] copyOnWrite;
+#endif
    delete pageTable;
 }
 
@@ -197,7 +297,8 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	For now, nothing!  Even with a TLB: our entries are tagged with
+//	our address space ID, so they can stay there.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState()
@@ -209,10 +310,282 @@ void AddrSpace::SaveState()
 //	this address space can run.
 //
 //      For now, tell the machine where to find the page table.
+//	With a TLB, tell it whose entries now match instead; it is
+//	refilled from our page table as pages are missed.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState()
 {
+#ifdef USE_TLB
+    machine->currentASID = asid;
+#else
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+#endif
+}
+
+#ifndef VM
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+// 	Called when the user program writes to the read-only page at
+//	"badVAddr".  If we only can't write it because we share it since
+//	a Fork, copy it to a frame of our own -- unless nobody else maps
+//	it any more -- and make it writable.  The write is then retried.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::CopyOnWrite(int badVAddr)
+{
+    unsigned int vpn = (unsigned) badVAddr / PageSize;
+    int frame, copy;
+
+    if (vpn >= numPages || !copyOnWrite[vpn]) {
+        printf("Write to read-only address 0x%x\n", badVAddr);
+        ASSERT(FALSE);
+    }
+    frame = pageTable[vpn].physicalPage;
+    if (machine->PageRefs(frame) > 1) {
+        copy = machine->AllocPage();
+        ASSERT_MSG(copy >= 0, "Out of physical memory.");
+        DEBUG('a', "Copying page %d from frame %d to frame %d\n",
+                vpn, frame, copy);
+        bcopy(&machine->mainMemory[frame * PageSize],
+                &machine->mainMemory[copy * PageSize], PageSize);
+        machine->FreePage(frame);
+        pageTable[vpn].physicalPage = copy;
+    }
+    pageTable[vpn].readOnly = FALSE;
+    copyOnWrite[vpn] = FALSE;
+}
+#endif // VM
+
+#ifdef VM
+//----------------------------------------------------------------------
+// AddrSpace::HandlePageFault
+// 	Called on a page fault at "badVAddr".  Page it in if it isn't in
+//	memory; with a TLB the fault may just be a TLB miss, and either
+//	way the translation is then loaded into the TLB.
+//
+//	The faulting instruction (or kernel access) is retried afterwards.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::HandlePageFault(int badVAddr)
+{
+    unsigned int vpn = (unsigned) badVAddr / PageSize;
+    TranslationEntry *entry;
+
+    if (vpn >= numPages) {
+        printf("Bad user address 0x%x, beyond the %d pages of the program\n",
+                badVAddr, numPages);
+        ASSERT(FALSE);
+    }
+    while ((entry = Resident(vpn)) == NULL) {	// it may be stolen again
+        stats->numPageFaults++;			// while we wait for the
+        coreMap->PageIn(this, vpn);		// core map
+    }
+#ifdef USE_TLB
+    tlbManager->Load(entry);
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPage
+// 	Fill physical "frame" with page "vpn": from the swap file, if it
+//	was changed and paged out before, else from the executable --
+//	zero, except for whatever the code and data segments put there.
+//	Then map it, in our page table or the inverted page table, and
+//	return the translation.  Called by the core map, which gave us
+//	the frame.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+AddrSpace::LoadPage(int vpn, int frame)
+{
+    char *page = &machine->mainMemory[frame * PageSize];
+    TranslationEntry *entry;
+
+    if (inSwap[vpn]) {
+        DEBUG('a', "Loading page %d from swap\n", vpn);
+        swapFile->ReadAt(page, PageSize, vpn * PageSize);
+    } else {
+        DEBUG('a', "Loading page %d from the executable\n", vpn);
+        bzero(page, PageSize);
+        LoadSegmentPage(&noffH.code, vpn * PageSize, page);
+        LoadSegmentPage(&noffH.initData, vpn * PageSize, page);
+    }
+
+#ifdef USE_TLB
+    if (pageTable == NULL)
+        entry = invertedPageTable->Insert(this, vpn, frame);
+    else
+#endif
+        entry = &pageTable[vpn];
+    entry->virtualPage = vpn;
+    entry->physicalPage = frame;
+    entry->valid = TRUE;
+    entry->use = FALSE;
+    entry->dirty = FALSE;
+    entry->readOnly = FALSE;
+#ifdef USE_TLB
+    entry->asid = asid;
+#endif
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::EvictPage
+// 	Page "vpn" is losing its frame.  If it has been changed since it
+//	was loaded, save it to swap, from where it will be loaded next.
+//	It is unmapped first, so that it can't be changed while it is
+//	being written.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::EvictPage(int vpn)
+{
+    TranslationEntry *entry = Resident(vpn);
+    int frame = entry->physicalPage;
+    bool dirty;
+
+#ifdef USE_TLB
+    tlbManager->Sync(entry, TRUE);
+#endif
+    dirty = entry->dirty;
+#ifdef USE_TLB
+    if (pageTable == NULL)
+        invertedPageTable->Remove(frame);
+    else
+#endif
+        entry->valid = FALSE;
+    if (dirty)
+        WriteSwap(vpn, &machine->mainMemory[frame * PageSize]);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CleanPage
+// 	Write page "vpn", which is in memory, to swap.  The page stays
+//	mapped, but is clean now: it can be dropped without writing it
+//	again, unless it changes -- even while it is being written, which
+//	is why it is marked clean first.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::CleanPage(int vpn)
+{
+    TranslationEntry *entry = Resident(vpn);
+
+#ifdef USE_TLB
+    tlbManager->Sync(entry, FALSE);
+#endif
+    entry->dirty = FALSE;
+    WriteSwap(vpn, &machine->mainMemory[entry->physicalPage * PageSize]);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::InitPaging
+// 	Set up for demand paging: no page is in memory, nor in swap yet.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::InitPaging()
+{
+    unsigned int i;
+
+    pageTable = NULL;
+#ifdef USE_TLB
+    asid = tlbManager->NewASID();
+    if (invertedPageTable == NULL)
+#endif
+    {
+        pageTable = new TranslationEntry[numPages];
+        for (i = 0; i < numPages; i++) {
+            pageTable[i].virtualPage = i;
+            pageTable[i].physicalPage = -1;
+            pageTable[i].valid = FALSE;
+            pageTable[i].use = FALSE;
+            pageTable[i].dirty = FALSE;
+            pageTable[i].readOnly = FALSE;
+        }
+    }
+    inSwap = new bool[numPages];
+    for (i = 0; i < numPages; i++)
+        inSwap[i] = FALSE;
+    swapFile = NULL;
+    sprintf(swapName, "SWAP%d", nextSwapId++);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Resident
+// 	Return the translation of page "vpn", or NULL if it is not in
+//	memory.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+AddrSpace::Resident(int vpn)
+{
+#ifdef USE_TLB
+    if (pageTable == NULL)
+        return invertedPageTable->Lookup(this, vpn);
+#endif
+    return pageTable[vpn].valid ? &pageTable[vpn] : NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReadPage
+// 	Copy page "vpn" into "into", paging it in first if need be.  Going
+//	through memory, rather than our files, waits for any page out of
+//	it to finish.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReadPage(int vpn, char *into)
+{
+    TranslationEntry *entry;
+
+    while ((entry = Resident(vpn)) == NULL)
+        coreMap->PageIn(this, vpn);
+    bcopy(&machine->mainMemory[entry->physicalPage * PageSize], into,
+            PageSize);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WriteSwap
+// 	Write page "vpn", whose contents are in "page", to our swap file,
+//	creating that the first time.  The page counts as being in swap
+//	from the start, so that the copy is waited for rather than
+//	ignored (see AddrSpace(AddrSpace *)).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::WriteSwap(int vpn, char *page)
+{
+    if (swapFile == NULL) {
+        DEBUG('a', "Creating swap file %s\n", swapName);
+        fileSystem->Create(swapName, 0);	// may be left from a crash
+        swapFile = fileSystem->Open(swapName);
+        ASSERT(swapFile != NULL);
+    }
+    DEBUG('a', "Writing page %d to swap\n", vpn);
+    inSwap[vpn] = TRUE;
+    swapFile->WriteAt(page, PageSize, vpn * PageSize);
+    stats->numPageOuts++;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadSegmentPage
+// 	Copy the part of segment "seg" that falls in the page at
+//	"virtAddr", if any, from the executable into "page".
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadSegmentPage(Segment *seg, int virtAddr, char *page)
+{
+    int from = max(seg->virtualAddr, virtAddr);
+    int to = min(seg->virtualAddr + seg->size, virtAddr + PageSize);
+
+    if (from < to)
+        execFile->ReadAt(&page[from - virtAddr], to - from,
+                            seg->inFileAddr + from - seg->virtualAddr);
 }
+#endif // VM
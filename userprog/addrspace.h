@@ -23,7 +23,10 @@ class AddrSpace {
   public:
     AddrSpace(OpenFile *executable);	// Create an address space,
 					// initializing it with the program
-					// stored in the file "executable"
+					// stored in the file "executable";
+					// the address space closes the file
+    AddrSpace(AddrSpace *parent);	// Create a copy of "parent", for
+					// Fork
     ~AddrSpace();			// De-allocate an address space
 
     void InitRegisters();		// Initialize user-level CPU registers,
@@ -32,12 +35,51 @@ class AddrSpace {
     void SaveState();			// Save/restore address space-specific
     void RestoreState();		// info on a context switch 
 
+#ifndef VM
+    void CopyOnWrite(int badVAddr);	// Give us our own copy of the
+					// shared page at "badVAddr"
+#endif
+#ifdef VM
+    void HandlePageFault(int badVAddr);	// Make the page at "badVAddr"
+					// usable, paging it in if need be
+    TranslationEntry *LoadPage(int vpn, int frame);
+					// Fill "frame" with page "vpn", and
+					// map it; returns the translation
+    void EvictPage(int vpn);		// Unmap page "vpn", saving it to
+					// swap if it was changed
+    void CleanPage(int vpn);		// Save page "vpn" to swap, leaving
+					// it mapped
+#endif
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
-					// for now!
+					// for now!  (NULL if the inverted
+					// page table is used instead)
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
     void MapSegment(Segment seg, OpenFile *executable);
+
+#ifndef VM
+    bool *copyOnWrite;			// which pages are only read-only
+					// because they are shared
+#endif
+#ifdef VM
+    NoffHeader noffH;			// where the segments are in...
+    OpenFile *execFile;			// ...the executable, kept open
+    bool *inSwap;			// which pages have a copy in swap
+    OpenFile *swapFile;			// created at the first page out
+    char swapName[16];
+#ifdef USE_TLB
+    int asid;				// tags our entries in the TLB
+#endif
+
+    void InitPaging();			// Nothing in memory, nor in swap
+    TranslationEntry *Resident(int vpn);	// Translation of page "vpn",
+					// NULL if it isn't in memory
+    void ReadPage(int vpn, char *into);
+    void WriteSwap(int vpn, char *page);
+    void LoadSegmentPage(Segment *seg, int virtAddr, char *page);
+#endif
 };
 
 #endif // ADDRSPACE_H
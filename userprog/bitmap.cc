@@ -8,6 +8,9 @@
 
 #include "copyright.h"
 #include "bitmap.h"
+#include "disk.h"
+
+#define AllOnes		(~0u)
 
 //----------------------------------------------------------------------
 // BitMap::BitMap
@@ -21,9 +24,15 @@ BitMap::BitMap(int nitems)
 { 
     numBits = nitems;
     numWords = divRoundUp(numBits, BitsInWord);
+    numSummaryWords = divRoundUp(numWords, BitsInWord);
     map = new unsigned int[numWords];
-    for (int i = 0; i < numBits; i++) 
-        Clear(i);
+    fullWords = new unsigned int[numSummaryWords];
+    dirtyWords = new unsigned int[numSummaryWords];
+    for (int i = 0; i < numWords; i++) 
+        map[i] = 0;
+    for (int i = 0; i < numSummaryWords; i++)
+        dirtyWords[i] = 0;
+    Rebuild();
 }
 
 //----------------------------------------------------------------------
@@ -33,7 +42,9 @@ BitMap::BitMap(int nitems)
 
 BitMap::~BitMap()
 { 
-    delete map;
+    delete [] map;
+    delete [] fullWords;
+    delete [] dirtyWords;
 }
 
 //----------------------------------------------------------------------
@@ -46,8 +57,17 @@ BitMap::~BitMap()
 void
 BitMap::Mark(int which) 
 { 
+    int w = which / BitsInWord;
+    unsigned int bit = 1u << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
-    map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    if (map[w] & bit)
+	return;
+    map[w] |= bit;
+    numClear--;
+    dirtyWords[w / BitsInWord] |= 1u << (w % BitsInWord);
+    if (map[w] == AllOnes)
+	fullWords[w / BitsInWord] |= 1u << (w % BitsInWord);
 }
     
 //----------------------------------------------------------------------
@@ -60,8 +80,16 @@ BitMap::Mark(int which)
 void 
 BitMap::Clear(int which) 
 {
+    int w = which / BitsInWord;
+    unsigned int bit = 1u << (which % BitsInWord);
+
     ASSERT(which >= 0 && which < numBits);
-    map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    if (!(map[w] & bit))
+	return;
+    map[w] &= ~bit;
+    numClear++;
+    dirtyWords[w / BitsInWord] |= 1u << (w % BitsInWord);
+    fullWords[w / BitsInWord] &= ~(1u << (w % BitsInWord));
 }
 
 //----------------------------------------------------------------------
@@ -76,7 +104,7 @@ BitMap::Test(int which)
 {
     ASSERT(which >= 0 && which < numBits);
     
-    if (map[which / BitsInWord] & (1 << (which % BitsInWord)))
+    if (map[which / BitsInWord] & (1u << (which % BitsInWord)))
 	return TRUE;
     else
 	return FALSE;
@@ -94,11 +122,104 @@ BitMap::Test(int which)
 int 
 BitMap::Find() 
 {
-    for (int i = 0; i < numBits; i++)
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
+    return FindNear(0);
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindNear
+// 	Like Find, but look for the first clear bit at or after "hint",
+//	wrapping around to the start of the bitmap.  Allocating a disk
+//	sector near the one before keeps a file's sectors together.
+//
+//	The rest of the hint's word is checked first; after that the
+//	summary leads straight to the next word with a clear bit, and
+//	count-trailing-zeros picks the bit out of it.
+//
+//	"hint" is where to start looking.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindNear(int hint)
+{
+    int w, which;
+    unsigned int clear;
+
+    if (numClear == 0)
+	return -1;
+    if (hint < 0 || hint >= numBits)
+	hint = 0;
+    w = hint / BitsInWord;
+    clear = ~map[w] & (AllOnes << (hint % BitsInWord));
+    if (clear == 0) {
+	w = NextFreeWord(w + 1);
+	if (w == -1)
+	    w = NextFreeWord(0);	// wrap around; there is one
+	clear = ~map[w];
+    }
+    which = w * BitsInWord + __builtin_ctz(clear);
+    Mark(which);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindRange
+// 	Find a run of "count" consecutive clear bits, set them, and
+//	return the number of the first.  Look from "hint" to the end
+//	first, then from the start; a run never wraps around.
+//
+//	The scan moves from one stretch of equal bits to the next with
+//	count-trailing-zeros, and over full words via the summary, so it
+//	never looks at bits one by one.
+//
+//	If there is no such run, return -1 and change nothing.
+//
+//	"count" is the length of the run needed.
+//	"hint" is where to start looking.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindRange(int count, int hint)
+{
+    int i, w, offset, len, run, start;
+    unsigned int clear;
+
+    if (count <= 0 || count > numClear)
+	return -1;
+    if (hint < 0 || hint >= numBits)
+	hint = 0;
+    for (int pass = 0; pass < 2; pass++) {
+	run = 0;
+	i = (pass == 0) ? hint : 0;
+	while (i < numBits) {
+	    w = i / BitsInWord;
+	    offset = i % BitsInWord;
+	    clear = ~map[w] >> offset;	// clear bits from i on, as ones
+	    if (clear == 0) {		// nothing more in this word
+		run = 0;
+		w = NextFreeWord(w + 1);
+		if (w == -1)
+		    break;
+		i = w * BitsInWord;
+		continue;
+	    }
+	    if (!(clear & 1)) {		// bit i is set: skip to a clear one
+		run = 0;
+		i += __builtin_ctz(clear);
+		continue;
+	    }
+	    // bits i .. i+len-1 are clear
+	    len = (~clear == 0) ? BitsInWord : __builtin_ctz(~clear);
+	    len = min(len, BitsInWord - offset);
+	    run += len;
+	    i += len;
+	    if (run >= count) {
+		start = i - run;
+		for (i = start; i < start + count; i++)
+		    Mark(i);
+		return start;
+	    }
 	}
+    }
     return -1;
 }
 
@@ -111,11 +232,56 @@ BitMap::Find()
 int 
 BitMap::NumClear() 
 {
-    int count = 0;
+    return numClear;
+}
+
+//----------------------------------------------------------------------
+// BitMap::NextFreeWord
+// 	Return the first word at or after "from" with a clear bit in it,
+//	or -1 if there is none, looking at the summary 32 words at a time.
+//----------------------------------------------------------------------
+
+int
+BitMap::NextFreeWord(int from)
+{
+    int s;
+    unsigned int notFull;
 
-    for (int i = 0; i < numBits; i++)
-	if (!Test(i)) count++;
-    return count;
+    if (from >= numWords)
+	return -1;
+    s = from / BitsInWord;
+    notFull = ~fullWords[s] & (AllOnes << (from % BitsInWord));
+    while (notFull == 0) {
+	if (++s >= numSummaryWords)
+	    return -1;
+	notFull = ~fullWords[s];
+    }
+    from = s * BitsInWord + __builtin_ctz(notFull);
+    return (from < numWords) ? from : -1;
+}
+
+//----------------------------------------------------------------------
+// BitMap::Rebuild
+// 	Recompute the summary and the count of clear bits after "map"
+//	was filled in wholesale.  Bits past the end of the bitmap are set,
+//	so that searches never return them.
+//----------------------------------------------------------------------
+
+void
+BitMap::Rebuild()
+{
+    int i;
+
+    if (numBits % BitsInWord != 0)
+	map[numWords - 1] |= AllOnes << (numBits % BitsInWord);
+    numClear = 0;
+    for (i = 0; i < numSummaryWords; i++)
+	fullWords[i] = AllOnes;		// words past numWords count as full
+    for (i = 0; i < numWords; i++) {
+	numClear += __builtin_popcount(~map[i]);
+	if (map[i] != AllOnes)
+	    fullWords[i / BitsInWord] &= ~(1u << (i % BitsInWord));
+    }
 }
 
 //----------------------------------------------------------------------
@@ -149,6 +315,9 @@ void
 BitMap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    Rebuild();
+    for (int i = 0; i < numSummaryWords; i++)
+        dirtyWords[i] = 0;
 }
 
 //----------------------------------------------------------------------
@@ -162,4 +331,36 @@ void
 BitMap::WriteBack(OpenFile *file)
 {
    file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+   for (int i = 0; i < numSummaryWords; i++)
+       dirtyWords[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// BitMap::WriteBackDirty
+// 	Like WriteBack, but only write the sector-sized pieces of the
+//	bitmap holding words that changed since it was last read or
+//	written; a bitmap kept in memory for good then costs one sector
+//	write per change, or none at all.
+//
+//	"file" is the place to write the bitmap to
+//----------------------------------------------------------------------
+
+void
+BitMap::WriteBackDirty(OpenFile *file)
+{
+    int wordsPerSector = SectorSize / sizeof(unsigned);
+    int first, last, w;
+
+    for (first = 0; first < numWords; first += wordsPerSector) {
+	last = min(first + wordsPerSector, numWords);
+	for (w = first; w < last; w++)
+	    if (dirtyWords[w / BitsInWord] & (1u << (w % BitsInWord)))
+		break;
+	if (w < last)
+	    file->WriteAt((char *)&map[first],
+			(last - first) * sizeof(unsigned),
+			first * sizeof(unsigned));
+    }
+    for (int i = 0; i < numSummaryWords; i++)
+	dirtyWords[i] = 0;
 }
@@ -5,6 +5,14 @@
 //	Represented as an array of unsigned integers, on which we do
 //	modulo arithmetic to find the bit we are interested in.
 //
+//	Searches look at a whole word at a time, and a second, summary
+//	bitmap records which words are completely full, so a search can
+//	skip 32 full words at a time.  The number of clear bits is kept
+//	as a running count.
+//
+//	Changed words are remembered, so that WriteBackDirty only writes
+//	the sectors of the bitmap file that actually changed.
+//
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
 //
@@ -43,6 +51,13 @@ class BitMap {
     int Find();            	// Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
+    int FindNear(int hint);	// Same, but the first clear bit at or
+				// after "hint", wrapping around
+    int FindRange(int count, int hint);
+				// Find "count" consecutive clear bits,
+				// starting at or after "hint" if possible,
+				// set them and return the first one.
+				// If there is no such run, return -1.
     int NumClear();		// Return the number of clear bits
 
     void Print();		// Print contents of bitmap
@@ -51,6 +66,10 @@ class BitMap {
     // write the bitmap to a file
     void FetchFrom(OpenFile *file); 	// fetch contents from disk 
     void WriteBack(OpenFile *file); 	// write contents to disk
+    void WriteBackDirty(OpenFile *file);
+					// write only the sectors of it
+					// that changed since the last
+					// FetchFrom/WriteBack
 
   private:
     int numBits;			// number of bits in the bitmap
@@ -59,6 +78,17 @@ class BitMap {
 					//  multiple of the number of bits in
 					//  a word)
     unsigned int *map;			// bit storage
+					// (bits past numBits are kept set)
+    unsigned int *fullWords;		// bit w set iff map[w] is all ones
+    int numSummaryWords;		// size of fullWords
+    int numClear;			// number of clear bits
+    unsigned int *dirtyWords;		// bit w set iff map[w] changed
+					// since the last write to disk
+
+    int NextFreeWord(int from);		// first not-full word >= "from",
+					// or -1
+    void Rebuild();			// recompute fullWords and numClear
+					// from "map"
 };
 
 #endif // BITMAP_H
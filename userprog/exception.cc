@@ -51,6 +51,30 @@
 //----------------------------------------------------------------------
 
 void exec_func(int);
+void fork_func(int);
+
+//----------------------------------------------------------------------
+// ReadUserMem, WriteUserMem
+// 	Access user memory on behalf of a system call.  With virtual
+//	memory the page may not be in memory (or in the TLB) yet:
+//	Machine::ReadMem then raises the page fault, which brings it in,
+//	but fails, so we try again.  Raising the fault leaves the machine
+//	in user mode, though we are still in the kernel.
+//----------------------------------------------------------------------
+
+static void
+ReadUserMem(int addr, int size, int *value)
+{
+    while (!machine->ReadMem(addr, size, value))
+        interrupt->setStatus(SystemMode);
+}
+
+static void
+WriteUserMem(int addr, int size, int value)
+{
+    while (!machine->WriteMem(addr, size, value))
+        interrupt->setStatus(SystemMode);
+}
 
 void
 ExceptionHandler(ExceptionType which) {
@@ -68,7 +92,7 @@ ExceptionHandler(ExceptionType which) {
                 char name[10];
                 int pos = 0, data;
                 while (1) {
-                    machine->ReadMem(address + pos, 1, &data);
+                    ReadUserMem(address + pos, 1, &data);
                     if (data == 0) {
                         name[pos] = '\0';
                         break;
@@ -85,7 +109,7 @@ ExceptionHandler(ExceptionType which) {
                 char name[10];
                 int pos = 0, data;
                 while (1) {
-                    machine->ReadMem(address + pos, 1, &data);
+                    ReadUserMem(address + pos, 1, &data);
                     if (data == 0) {
                         name[pos] = '\0';
                         break;
@@ -114,14 +138,14 @@ ExceptionHandler(ExceptionType which) {
 
                 if (fd == ConsoleInput) {
                     for (int i = 0; i < size; ++i)
-                        machine->WriteMem(buffer + i, 1, int(getchar()));
+                        WriteUserMem(buffer + i, 1, int(getchar()));
                     machine->WriteRegister(2, size);
                     DEBUG('c', "SYSCALL: Read from stdin, bytes read: %d\n", size);
                 } else {
                     char content[size];
                     int result = openfile->Read(content, size);
                     for (int i = 0; i < result; ++i)
-                        machine->WriteMem(buffer + i, 1, int(content[i]));
+                        WriteUserMem(buffer + i, 1, int(content[i]));
                     machine->WriteRegister(2, result);
                     DEBUG('c', "SYSCALL: Read a file, bytes read: %d\n", result);
                 }
@@ -136,7 +160,7 @@ ExceptionHandler(ExceptionType which) {
                 int data;
                 DEBUG('c', "SYSCALL: Wrote buffer %d %d %d\n", buffer, size, fd);
                 for (int i = 0; i < size; ++i) {
-                    machine->ReadMem(buffer + i, 1, &data);
+                    ReadUserMem(buffer + i, 1, &data);
                     content[i] = char(data);
                 }
                 if (fd == ConsoleOutput) {
@@ -153,14 +177,35 @@ ExceptionHandler(ExceptionType which) {
             }
             case SC_Exec: {
                 int address = machine->ReadRegister(4);
+                char *name = new char[60];	// exec_func deletes it
+                int pos = 0, data;
+                while (1) {
+                    ReadUserMem(address + pos, 1, &data);
+                    if (data == 0) {
+                        name[pos] = '\0';
+                        break;
+                    }
+                    name[pos++] = (char) data;
+                }
                 Thread *newThread = new Thread("new thread");
-                newThread->Fork(exec_func, address);
+                newThread->Fork(exec_func, (int) name);
                 currentThread->Yield();
                 machine->WriteRegister(2, newThread->getTID());
                 machine->AdvancePC();
                 DEBUG('c', "SYSCALL: exec\n");
                 break;
             }
+            case SC_Fork: {
+                Thread *child = new Thread("forked thread");
+                machine->AdvancePC();		// both return from Fork
+                child->space = new AddrSpace(currentThread->space);
+                machine->WriteRegister(2, 0);
+                child->SaveUserState();		// our registers, but 0
+                machine->WriteRegister(2, child->getTID());
+                child->Fork(fork_func, 0);
+                DEBUG('c', "SYSCALL: fork, child: %d\n", child->getTID());
+                break;
+            }
             case SC_Yield: {
                 DEBUG('c', "SYSCALL: yield\n");
                 machine->AdvancePC();
@@ -178,7 +223,12 @@ ExceptionHandler(ExceptionType which) {
             case SC_Exit: {
                 int status = machine->ReadRegister(4);
                 DEBUG('c', "SYSCALL: exit, code: %d\n", status);
+#ifdef VM
+                delete currentThread->space;	// gives back its frames
+                currentThread->space = NULL;
+#else
                 machine->DeallocPageTable();
+#endif
                 machine->AdvancePC();
                 currentThread->Finish();
                 break;
@@ -206,7 +256,7 @@ ExceptionHandler(ExceptionType which) {
                 int pos = 0;
                 int data;
                 while(1) {
-                    machine->ReadMem(address + pos, 1, &data);
+                    ReadUserMem(address + pos, 1, &data);
                     if (data == 0) {
                         name[pos] = '\0';
                         break;
@@ -225,7 +275,7 @@ ExceptionHandler(ExceptionType which) {
                 int pos = 0;
                 int data;
                 while(1) {
-                    machine->ReadMem(address + pos, 1, &data);
+                    ReadUserMem(address + pos, 1, &data);
                     if (data == 0) {
                         name[pos] = '\0';
                         break;
@@ -244,7 +294,7 @@ ExceptionHandler(ExceptionType which) {
                 int pos = 0;
                 int data;
                 while(1) {
-                    machine->ReadMem(address + pos, 1, &data);
+                    ReadUserMem(address + pos, 1, &data);
                     if (data == 0) {
                         name[pos] = '\0';
                         break;
@@ -263,7 +313,7 @@ ExceptionHandler(ExceptionType which) {
                 int pos = 0;
                 int data;
                 while(1) {
-                    machine->ReadMem(address + pos, 1, &data);
+                    ReadUserMem(address + pos, 1, &data);
                     if (data == 0) {
                         name[pos] = '\0';
                         break;
@@ -299,7 +349,14 @@ ExceptionHandler(ExceptionType which) {
                 break;
             }
         }
-        // Fork not implemented yet
+#ifndef VM
+    } else if (which == ReadOnlyException && currentThread->space != NULL) {
+        currentThread->space->CopyOnWrite(machine->ReadRegister(BadVAddrReg));
+#endif
+#ifdef VM
+    } else if (which == PageFaultException && currentThread->space != NULL) {
+        currentThread->space->HandlePageFault(machine->ReadRegister(BadVAddrReg));
+#endif
     } else {
         printf("Unexpected user mode exception %d %d\n", which, type);
         ASSERT(FALSE);
@@ -312,23 +369,21 @@ void Machine::AdvancePC() {
     WriteRegister(NextPCReg, registers[NextPCReg] + sizeof(int));
 }
 
-void exec_func(int address) {
-    char name[60];
-    int pos = 0, data;
-    while (1) {
-        machine->ReadMem(address + pos, 1, &data);
-        if (data == 0) {
-            name[pos] = '\0';
-            break;
-        }
-        name[pos++] = (char) data;
-    }
+void exec_func(int arg) {
+    char *name = (char *) arg;		// read by the parent, which may
+					// have paged it out by now
     OpenFile *executable = fileSystem->Open(name);
     AddrSpace *space;
+    delete [] name;
     space = new AddrSpace(executable);
-    currentThread->space = space;
-    delete executable;
+    currentThread->space = space;	// it closes the file when done
     space->InitRegisters();
     space->RestoreState();
     machine->Run();
-}
\ No newline at end of file
+}
+
+void fork_func(int arg) {
+    currentThread->RestoreUserState();	// as the parent left them
+    currentThread->space->RestoreState();
+    machine->Run();
+}
@@ -32,8 +32,7 @@ StartProcess(char *filename)
 
     DEBUG('a', "inited first user prog\n");
     space = new AddrSpace(executable);
-    currentThread->space = space;
-    delete executable;			// close file
+    currentThread->space = space;	// it closes the file when done
 
     space->InitRegisters();		// set the initial register values
     space->RestoreState();		// load page table register
@@ -54,7 +54,7 @@
 void Halt();		
  
 
-/* Address space control operations: Exit, Exec, and Join */
+/* Address space control operations: Exit, Exec, Fork, and Join */
 
 /* This user program is done (status = 0 means exited normally). */
 void Exit(int status);	
@@ -71,6 +71,13 @@ SpaceId Exec(char *name);
  * Return the exit status.
  */
 int Join(SpaceId id); 	
+
+/* Make a copy of the current user program, which runs on from the
+ * return of Fork, like it.  Return the copy's identifier to the
+ * original, and 0 to the copy.  Their memory is only really copied,
+ * a page at a time, as either of them changes it.
+ */
+SpaceId Fork();
  
 
 /* File system operations: Create, Open, Read, Write, Close
@@ -118,15 +125,10 @@ void Close(OpenFileId id);
 
 
 
-/* User-level thread operations: Fork and Yield.  To allow multiple
+/* User-level thread operations: Yield.  To allow multiple
  * threads to run within a user program. 
  */
 
-/* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
- */
-void Fork(void (*func)());
-
 /* Yield the CPU to another runnable thread, whether in this address space 
  * or not. 
  */
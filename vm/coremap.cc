@@ -0,0 +1,282 @@
+// coremap.cc
+//	Routines to manage physical memory for demand paging, and the
+//	page replacement policies.
+//
+//	Free frames come from the machine's frame bitmap, as before.  When
+//	there are none left, the replacement policy picks a frame to take.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "coremap.h"
+#include "system.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// CoreMap::CoreMap
+// 	Initialize the core map; no frame belongs to anybody yet.
+//
+//	"replacement" chooses the frame to take when none is free; the
+//	core map deletes it.
+//----------------------------------------------------------------------
+
+CoreMap::CoreMap(ReplacementPolicy *replacement)
+{
+    lock = new Lock("core map");
+    for (int i = 0; i < NumPhysPages; i++) {
+        frames[i].space = NULL;
+        frames[i].vpn = -1;
+        frames[i].pte = NULL;
+        frames[i].pinCount = 0;
+        frames[i].age = 0;
+        frames[i].lastUse = 0;
+    }
+    if (replacement == NULL)
+        replacement = new FIFOReplacement;
+    policy = replacement;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::~CoreMap
+// 	De-allocate the core map.
+//----------------------------------------------------------------------
+
+CoreMap::~CoreMap()
+{
+    delete lock;
+    delete policy;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::PageIn
+// 	Bring page "vpn" of "space" into memory: take a free frame, or
+//	have one stolen if there is none, and have the address space
+//	fill it.  The frame is pinned while it is being filled.
+//----------------------------------------------------------------------
+
+void
+CoreMap::PageIn(AddrSpace *space, int vpn)
+{
+    int frame;
+
+    lock->Acquire();
+#ifdef USE_TLB
+    tlbManager->SyncAll();		// the policy needs the use bits
+#endif
+    policy->PageFault(frames);
+    frame = machine->AllocPage();
+    if (frame < 0) {
+        frame = Evict();
+        machine->InvalidateDecodedPage(frame);	// it may have held code
+    }
+    frames[frame].space = space;
+    frames[frame].vpn = vpn;
+    frames[frame].age = 0;
+    frames[frame].lastUse = stats->totalTicks;
+    DEBUG('a', "Paging in page %d to frame %d\n", vpn, frame);
+    Pin(frame);
+    frames[frame].pte = space->LoadPage(vpn, frame);
+    Unpin(frame);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// CoreMap::FreeFrames
+// 	Give back every frame held by "space".  If one of its pages is
+//	being written out just now, this waits for that to finish.
+//----------------------------------------------------------------------
+
+void
+CoreMap::FreeFrames(AddrSpace *space)
+{
+    lock->Acquire();
+    for (int i = 0; i < NumPhysPages; i++)
+        if (frames[i].space == space) {
+            ASSERT(frames[i].pinCount == 0);
+#ifdef USE_TLB
+            if (invertedPageTable != NULL)
+                invertedPageTable->Remove(i);
+#endif
+            frames[i].space = NULL;
+            frames[i].vpn = -1;
+            frames[i].pte = NULL;
+            machine->FreePage(i);
+        }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Pin, CoreMap::Unpin
+// 	Keep a frame from being taken while it is being used outside the
+//	owner's page table -- filled, written out, or copied.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Pin(int frame)
+{
+    frames[frame].pinCount++;
+}
+
+void
+CoreMap::Unpin(int frame)
+{
+    ASSERT(frames[frame].pinCount > 0);
+    frames[frame].pinCount--;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Evict
+// 	Take the frame the policy picks from whoever holds it, writing
+//	its page out if need be, and return it.  Only called when every
+//	frame is in use.
+//----------------------------------------------------------------------
+
+int
+CoreMap::Evict()
+{
+    int frame = policy->FindVictim(frames);
+
+    ASSERT(frames[frame].space != NULL && frames[frame].pinCount == 0);
+    DEBUG('a', "Evicting page %d from frame %d\n", frames[frame].vpn, frame);
+    Pin(frame);
+    frames[frame].space->EvictPage(frames[frame].vpn);
+    Unpin(frame);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FIFOReplacement::FindVictim
+// 	Take the next unpinned frame in turn.
+//----------------------------------------------------------------------
+
+int
+FIFOReplacement::FindVictim(FrameEntry *frames)
+{
+    for (int n = 0; n < NumPhysPages; n++) {
+        int frame = hand;
+
+        hand = (hand + 1) % NumPhysPages;
+        if (frames[frame].pinCount == 0)
+            return frame;
+    }
+    ASSERT_MSG(FALSE, "Every frame is pinned.");
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// ClockReplacement::FindVictim
+// 	Sweep for a page that is neither used nor dirty; on the next lap
+//	settle for one that is only dirty, clearing use bits on the way.
+//	Four laps at most: after two, every use bit has been cleared.
+//----------------------------------------------------------------------
+
+int
+ClockReplacement::FindVictim(FrameEntry *frames)
+{
+    for (int lap = 0; lap < 4; lap++)
+        for (int n = 0; n < NumPhysPages; n++) {
+            int frame = hand;
+            TranslationEntry *pte = frames[frame].pte;
+
+            hand = (hand + 1) % NumPhysPages;
+            if (frames[frame].pinCount > 0)
+                continue;
+            if (!pte->use && !pte->dirty)
+                return frame;
+            if (lap % 2 == 1) {
+                if (!pte->use)
+                    return frame;
+                pte->use = FALSE;
+            }
+        }
+    ASSERT_MSG(FALSE, "Every frame is pinned.");
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AgingReplacement::PageFault
+// 	Shift each frame's use bit into its age.
+//----------------------------------------------------------------------
+
+void
+AgingReplacement::PageFault(FrameEntry *frames)
+{
+    for (int i = 0; i < NumPhysPages; i++)
+        if (frames[i].space != NULL) {
+            frames[i].age = (frames[i].age >> 1)
+                                | (frames[i].pte->use ? 0x80 : 0);
+            frames[i].pte->use = FALSE;
+        }
+}
+
+//----------------------------------------------------------------------
+// AgingReplacement::FindVictim
+// 	Take the unpinned frame with the smallest age; between equals,
+//	one that needn't be written out.
+//----------------------------------------------------------------------
+
+int
+AgingReplacement::FindVictim(FrameEntry *frames)
+{
+    int victim = -1;
+
+    for (int i = 0; i < NumPhysPages; i++) {
+        if (frames[i].pinCount > 0)
+            continue;
+        if (victim < 0 || frames[i].age < frames[victim].age
+                || (frames[i].age == frames[victim].age
+                    && frames[victim].pte->dirty && !frames[i].pte->dirty))
+            victim = i;
+    }
+    ASSERT_MSG(victim >= 0, "Every frame is pinned.");
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// WSClockReplacement::FindVictim
+// 	Sweep for a clean page outside its owner's working set.  A used
+//	page has its use bit cleared and its time updated; an old dirty
+//	one is written out.  After two laps without finding one, every
+//	page is in some working set: take the one used longest ago,
+//	preferring clean ones.
+//----------------------------------------------------------------------
+
+int
+WSClockReplacement::FindVictim(FrameEntry *frames)
+{
+    int now = stats->totalTicks;
+    int oldest = -1;
+
+    for (int n = 0; n < 2 * NumPhysPages; n++) {
+        int frame = hand;
+        FrameEntry *f = &frames[frame];
+
+        hand = (hand + 1) % NumPhysPages;
+        if (f->pinCount > 0)
+            continue;
+        if (f->pte->use) {
+            f->pte->use = FALSE;
+            f->lastUse = now;
+            continue;
+        }
+        if (now - f->lastUse > WorkingSetWindow) {
+            if (!f->pte->dirty)
+                return frame;
+            f->pinCount++;
+            f->space->CleanPage(f->vpn);
+            f->pinCount--;
+        }
+    }
+    for (int i = 0; i < NumPhysPages; i++) {
+        if (frames[i].pinCount > 0)
+            continue;
+        if (oldest < 0 || (frames[oldest].pte->dirty && !frames[i].pte->dirty)
+                || (frames[oldest].pte->dirty == frames[i].pte->dirty
+                    && frames[i].lastUse < frames[oldest].lastUse))
+            oldest = i;
+    }
+    ASSERT_MSG(oldest >= 0, "Every frame is pinned.");
+    return oldest;
+}
@@ -0,0 +1,139 @@
+// coremap.h
+//	Data structures for demand paging: the core map, which records
+//	which page of which address space is in each physical frame.
+//
+//	Pages are brought in only when a user program touches them.
+//	When no frame is free, one is taken from some address space (its
+//	page written to that space's swap file first, if it was changed),
+//	so programs can be bigger than physical memory.  Which frame is
+//	taken is up to a replacement policy.
+//
+//	One page fault is handled at a time: paging in or out may wait
+//	for the disk, and a page must not be stolen while it is on its
+//	way in or out.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef COREMAP_H
+#define COREMAP_H
+
+#include "machine.h"
+
+class AddrSpace;
+class Lock;
+
+// What the core map knows about one physical frame.  The use and dirty
+// bits are those in the owner's page table entry, set by Translate.
+
+class FrameEntry {
+  public:
+    AddrSpace *space;			// whose page is here, NULL if free
+    int vpn;				// which page of it
+    TranslationEntry *pte;		// the page's translation
+    int pinCount;			// if > 0, the frame may not be taken
+    unsigned char age;			// use bits seen at the last page
+					// faults, the latest in the top bit
+    int lastUse;			// when the page was last seen used
+};
+
+// The following class defines a page replacement policy -- which frame
+// to take when none is free.  The core map does the paging; a policy
+// only has to choose.  Both routines are called with the core map locked,
+// and with the use and dirty bits up to date.
+
+class ReplacementPolicy {
+  public:
+    virtual ~ReplacementPolicy() {}
+
+    virtual void PageFault(FrameEntry *frames) {}
+					// Called on every page fault
+    virtual int FindVictim(FrameEntry *frames) = 0;
+					// Pick a frame, in use but not
+					// pinned, to take
+};
+
+// First in, first out: frames are taken in turn, round-robin -- nearly
+// the order they were filled in, since free frames are handed out in
+// order.
+
+class FIFOReplacement : public ReplacementPolicy {
+  public:
+    FIFOReplacement() { hand = 0; }
+    int FindVictim(FrameEntry *frames);
+
+  private:
+    int hand;				// next frame to take
+};
+
+// CLOCK, in the enhanced form that considers the dirty bit too: the hand
+// first looks for a page neither used nor changed since it last came
+// by, which can be dropped without writing it out; failing that, for an
+// unused but changed one, clearing use bits as it goes.
+
+class ClockReplacement : public ReplacementPolicy {
+  public:
+    ClockReplacement() { hand = 0; }
+    int FindVictim(FrameEntry *frames);
+
+  private:
+    int hand;				// where the sweep resumes
+};
+
+// Aging, an approximation of least recently used: at every page fault
+// each frame's use bit is shifted into the top of its age, and cleared.
+// The frame with the smallest age has gone longest without being used.
+
+class AgingReplacement : public ReplacementPolicy {
+  public:
+    void PageFault(FrameEntry *frames);
+    int FindVictim(FrameEntry *frames);
+};
+
+// WSClock: like CLOCK, but a page used within the last WorkingSetWindow
+// ticks is in its owner's working set, and is left alone.  An old page
+// that was changed is written out as the hand passes, to be taken
+// clean next time round.  Time is the system's total ticks, not each
+// owner's own.
+
+#define WorkingSetWindow	5000
+
+class WSClockReplacement : public ReplacementPolicy {
+  public:
+    WSClockReplacement() { hand = 0; }
+    int FindVictim(FrameEntry *frames);
+
+  private:
+    int hand;				// where the sweep resumes
+};
+
+// The following class defines the core map.
+
+class CoreMap {
+  public:
+    CoreMap(ReplacementPolicy *replacement);
+					// All frames start out free; replace
+					// FIFO if "replacement" is NULL
+    ~CoreMap();
+
+    void PageIn(AddrSpace *space, int vpn);
+					// Find a frame for page "vpn" of
+					// "space", and load it
+    void FreeFrames(AddrSpace *space);	// "space" is going away; free
+					// the frames it holds
+
+    void Pin(int frame);		// Keep "frame" from being taken,
+    void Unpin(int frame);		// until as many Unpins as Pins
+
+  private:
+    Lock *lock;				// held while handling a fault
+    FrameEntry frames[NumPhysPages];
+    ReplacementPolicy *policy;		// which frame to take
+
+    int Evict();			// Take a frame from its owner
+};
+
+#endif // COREMAP_H
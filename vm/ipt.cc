@@ -0,0 +1,104 @@
+// ipt.cc
+//	Routines to manage the inverted page table.
+//
+//	The table needs no lock of its own: it is only changed by the
+//	core map, with its lock held, and looked up without waiting.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "ipt.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// InvertedPageTable::InvertedPageTable
+// 	Initialize an inverted page table with no frame mapped.
+//----------------------------------------------------------------------
+
+InvertedPageTable::InvertedPageTable()
+{
+    int i;
+
+    for (i = 0; i < NumPhysPages; i++) {
+        owner[i] = NULL;
+        entries[i].valid = FALSE;
+        next[i] = -1;
+    }
+    for (i = 0; i < IPTHashSize; i++)
+        anchor[i] = -1;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Lookup
+// 	Return the translation for page "vpn" of address space "space",
+//	or NULL if that page is not in memory.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+InvertedPageTable::Lookup(AddrSpace *space, int vpn)
+{
+    for (int i = anchor[Hash(space, vpn)]; i >= 0; i = next[i])
+        if (owner[i] == space && entries[i].virtualPage == vpn)
+            return &entries[i];
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Insert
+// 	Record that page "vpn" of "space" is in "frame", which must not
+//	be mapped already.  Return the translation, for the caller to
+//	fill in the rest of.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+InvertedPageTable::Insert(AddrSpace *space, int vpn, int frame)
+{
+    unsigned int h = Hash(space, vpn);
+
+    ASSERT(owner[frame] == NULL);
+    owner[frame] = space;
+    entries[frame].virtualPage = vpn;
+    entries[frame].physicalPage = frame;
+    next[frame] = anchor[h];
+    anchor[h] = frame;
+    return &entries[frame];
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Remove
+// 	Forget the page in "frame", if there is one.
+//----------------------------------------------------------------------
+
+void
+InvertedPageTable::Remove(int frame)
+{
+    int *link;
+
+    if (owner[frame] == NULL)
+        return;
+    link = &anchor[Hash(owner[frame], entries[frame].virtualPage)];
+    while (*link != frame) {
+        ASSERT(*link >= 0);
+        link = &next[*link];
+    }
+    *link = next[frame];
+    owner[frame] = NULL;
+    entries[frame].valid = FALSE;
+    next[frame] = -1;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Hash
+// 	Which chain page "vpn" of "space" belongs on.
+//----------------------------------------------------------------------
+
+unsigned int
+InvertedPageTable::Hash(AddrSpace *space, int vpn)
+{
+    unsigned int h = (unsigned int) ((unsigned long) space >> 4);
+
+    h ^= (unsigned int) vpn * 2654435761u;	// Knuth's multiplicative
+    return (h ^ (h >> 16)) & (IPTHashSize - 1);
+}
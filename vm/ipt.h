@@ -0,0 +1,58 @@
+// ipt.h
+//	Data structures for an inverted page table: one translation per
+//	physical frame, for the whole system, instead of one per virtual
+//	page in each address space.  Its size depends only on how much
+//	memory there is, however big (or sparse) the address spaces are.
+//
+//	A translation is found by hashing the address space and virtual
+//	page number into the hash anchor table, which gives the first
+//	frame of a chain of frames with the same hash.
+//
+//	Only pages in memory have a translation.  It is enough as the
+//	source of TLB refills, so the inverted page table can only be
+//	used with a TLB: the hardware can't walk it itself.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef IPT_H
+#define IPT_H
+
+#include "machine.h"
+
+class AddrSpace;
+
+#define IPTHashSize	(2 * NumPhysPages)	// a power of two, to keep
+						// the chains short
+
+// The following class defines the inverted page table.
+
+class InvertedPageTable {
+  public:
+    InvertedPageTable();		// No frame is mapped
+
+    TranslationEntry *Lookup(AddrSpace *space, int vpn);
+					// Translation of page "vpn" of
+					// "space", NULL if not in memory
+    TranslationEntry *Insert(AddrSpace *space, int vpn, int frame);
+					// Map page "vpn" of "space" onto
+					// "frame"; the caller fills in the
+					// translation returned
+    void Remove(int frame);		// Unmap "frame"
+
+  private:
+    AddrSpace *owner[NumPhysPages];	// whose page each frame holds,
+					// NULL if none
+    TranslationEntry entries[NumPhysPages];
+					// entries[i] maps a page onto frame i
+    int next[NumPhysPages];		// next frame in the same chain,
+					// -1 at the end
+    int anchor[IPTHashSize];		// first frame in each chain
+
+    static unsigned int Hash(AddrSpace *space, int vpn);
+};
+
+#endif // IPT_H
@@ -0,0 +1,165 @@
+// tlbmanager.cc
+//	Routines to manage the software-loaded TLB: refilling it on a
+//	miss, and keeping the page tables' use and dirty bits right.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "tlbmanager.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// TLBManager::TLBManager
+// 	Start with an empty TLB, and every address space ID free.
+//
+//	"how" says which entry to replace when the TLB is full.
+//----------------------------------------------------------------------
+
+TLBManager::TLBManager(TLBReplacement how)
+{
+    replacement = how;
+    for (int i = 0; i < MaxTLBSize; i++) {
+        machine->tlb[i].valid = FALSE;
+        source[i] = NULL;
+    }
+    nextSlot = 0;
+    asids = new BitMap(NumASIDs);
+}
+
+//----------------------------------------------------------------------
+// TLBManager::~TLBManager
+// 	De-allocate the TLB manager.
+//----------------------------------------------------------------------
+
+TLBManager::~TLBManager()
+{
+    delete asids;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::NewASID
+// 	Return an unused address space ID.  Nothing in the TLB has it:
+//	a freed ID has its entries dropped.
+//----------------------------------------------------------------------
+
+int
+TLBManager::NewASID()
+{
+    int asid = asids->Find();
+
+    ASSERT_MSG(asid >= 0, "Too many address spaces for the TLB's ID tags.");
+    return asid;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::FreeASID
+// 	The address space with ID "asid" is going away: drop its entries,
+//	without copying anything back, and make the ID available again.
+//----------------------------------------------------------------------
+
+void
+TLBManager::FreeASID(int asid)
+{
+    for (int i = 0; i < machine->tlbSize; i++)
+        if (machine->tlb[i].valid && machine->tlb[i].asid == asid) {
+            machine->tlb[i].valid = FALSE;
+            source[i] = NULL;
+        }
+    asids->Clear(asid);
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Load
+// 	Put a copy of page table "entry", which must be valid, into the
+//	TLB: into a free entry if there is one, otherwise replacing one
+//	chosen at random, first in first out, or least recently used.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Load(TranslationEntry *entry)
+{
+    TranslationEntry *tlb = machine->tlb;
+    int slot = -1;
+
+    ASSERT(entry->valid);
+    for (int i = 0; i < machine->tlbSize; i++)
+        if (!tlb[i].valid) {
+            slot = i;
+            break;
+        }
+    if (slot < 0) {
+        switch (replacement) {
+          case TLBRandom:
+            slot = Random() % machine->tlbSize;
+            break;
+          case TLBFIFO:
+            slot = nextSlot;
+            nextSlot = (nextSlot + 1) % machine->tlbSize;
+            break;
+          case TLBLRU:
+            slot = 0;
+            for (int i = 1; i < machine->tlbSize; i++)
+                if (machine->tlbLastUse[i] < machine->tlbLastUse[slot])
+                    slot = i;
+            break;
+        }
+        WriteBack(slot);
+    }
+    tlb[slot] = *entry;
+    tlb[slot].use = tlb[slot].dirty = FALSE;	// the page table has those
+    source[slot] = entry;
+    machine->tlbLastUse[slot] = stats->numTLBHits;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Sync
+// 	Copy the use and dirty bits of the TLB's copy of "entry", if it
+//	has one, back to "entry".  If "drop", remove the copy, say because
+//	the page is leaving memory.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Sync(TranslationEntry *entry, bool drop)
+{
+    for (int i = 0; i < machine->tlbSize; i++)
+        if (machine->tlb[i].valid && source[i] == entry) {
+            WriteBack(i);
+            if (drop) {
+                machine->tlb[i].valid = FALSE;
+                source[i] = NULL;
+            }
+        }
+}
+
+//----------------------------------------------------------------------
+// TLBManager::SyncAll
+// 	Copy back the use and dirty bits of every entry in the TLB, so that
+//	the page tables show which pages have been used or changed.
+//----------------------------------------------------------------------
+
+void
+TLBManager::SyncAll()
+{
+    for (int i = 0; i < machine->tlbSize; i++)
+        if (machine->tlb[i].valid)
+            WriteBack(i);
+}
+
+//----------------------------------------------------------------------
+// TLBManager::WriteBack
+// 	Add the use and dirty bits the hardware set in TLB entry "slot" to
+//	the page table entry it came from, and clear them in the TLB, so
+//	that the page table can clear its own.
+//----------------------------------------------------------------------
+
+void
+TLBManager::WriteBack(int slot)
+{
+    TranslationEntry *copy = &machine->tlb[slot];
+
+    source[slot]->use |= copy->use;
+    source[slot]->dirty |= copy->dirty;
+    copy->use = copy->dirty = FALSE;
+}
@@ -0,0 +1,65 @@
+// tlbmanager.h
+//	Data structures for managing the software-loaded TLB.
+//
+//	The TLB is only a cache of page table entries: on a miss, the
+//	kernel finds the entry in the running address space's page table
+//	and loads it, replacing another if the TLB is full.  The use and
+//	dirty bits the hardware sets are in the TLB's copy, so they are
+//	copied back to the page table whenever the page table's own must
+//	be right -- when an entry is replaced, or its page is paged out,
+//	or the core map is choosing a page to take.
+//
+//	Entries are tagged with an address space ID, so entries of the
+//	other address spaces can stay in the TLB across context switches.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef TLBMANAGER_H
+#define TLBMANAGER_H
+
+#include "machine.h"
+
+class BitMap;
+
+#define NumASIDs	MAX_THREAD_COUNT	// address spaces that can be
+					// around at once: one per thread
+					// at most (see system.h)
+
+// Which entry to replace when the TLB is full.
+enum TLBReplacement { TLBRandom, TLBFIFO, TLBLRU };
+
+// The following class defines the kernel's side of the TLB.
+
+class TLBManager {
+  public:
+    TLBManager(TLBReplacement how);	// Replace entries "how"
+    ~TLBManager();
+
+    int NewASID();			// Tag for a new address space
+    void FreeASID(int asid);		// Address space "asid" is gone;
+					// drop its entries
+
+    void Load(TranslationEntry *entry);	// Load page table "entry" into
+					// the TLB, after a miss
+    void Sync(TranslationEntry *entry, bool drop);
+					// Copy the TLB's use and dirty bits
+					// for "entry" back to it; if "drop",
+					// remove it from the TLB too
+    void SyncAll();			// Copy back the bits of every entry
+
+  private:
+    TLBReplacement replacement;
+    TranslationEntry *source[MaxTLBSize];
+					// page table entry each TLB entry
+					// was loaded from
+    int nextSlot;			// FIFO: the next entry to replace
+    BitMap *asids;			// which address space IDs are taken
+
+    void WriteBack(int slot);		// Copy back one entry's bits
+};
+
+#endif // TLBMANAGER_H